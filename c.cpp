@@ -10,6 +10,135 @@
 //   ./comparer --file1 <path> --instcol1 <cols> --valcol1 <col> --file2 <path> --instcol2 <cols> --valcol2 <col>
 //   Example: ./comparer --file1 fileA.txt --instcol1 0,1 --valcol1 3 --file2 fileB.txt --instcol2 0,1 --valcol2 4
 //
+// Options:
+//   --index        Use the sidecar line index '<file>.cidx' to split the files into chunks
+//                  with equal line counts, or build it during this parse if it is missing
+//                  or stale. --index_stride <n> sets the lines per index block (default 1024).
+//   --delim whitespace|comma|tab
+//                  Field delimiter of both files (default: runs of whitespace).
+//   --comparison_type numeric|string|decimal
+//                  'string' compares values as text without parsing numbers. 'decimal' reads
+//                  plain decimals exactly as scaled 64-bit integers, so '0.1' and '0.10000'
+//                  are equal and differences are exact; other values are parsed as doubles.
+//   --lazy_raw [pread|mmap]
+//                  Keep only each value's file offset and length while parsing and read
+//                  the raw text back for the matched instances when writing comparison.csv.
+//   --units        Read values decorated with a label or unit as numbers scaled by the SI
+//                  prefix: '12.5mV' is 0.0125, '0.83(V)' is 0.83 and 'I=3.2uA' is 3.2e-6.
+//                  Without it, a value reads as its leading number ('12.5mV' is 12.5) or
+//                  as a string.
+//   --valexpr1 <expr>, --valexpr2 <expr>
+//                  Compare a value derived from several columns instead of --valcol1/2:
+//                  + - * / and parentheses over colN (numbered like --valcol), numbers,
+//                  the numeric header constants of the file and min(), max(), abs(), e.g.
+//                  'col4 + col5' or 'max(col4, col5) / NOMINAL_VOLTAGE'. The expression
+//                  is compiled once and evaluated over batches of lines.
+//   --where1 <pred>, --where2 <pred>
+//                  Compare only the matched instances whose value passes the predicate in
+//                  at least one file that has one, e.g. 'value > 0.05 * NOMINAL_VOLTAGE'.
+//                  A predicate is an --valexpr expression that may also use 'value' (the
+//                  compared value), < <= > >= == != and 'and'/'or'. It is checked as lines
+//                  are parsed; failing lines keep only their key, so missing_instances.txt
+//                  is unchanged. Values failing on one side only are read back afterwards.
+//   --dict_values  Dictionary-encode non-numeric values: both files share one concurrent
+//                  dictionary, each instance stores a 32-bit code, and codes are compared.
+//   --follow1, --follow2
+//                  Tail file1/file2 while another tool is still writing it, parsing lines
+//                  as they are appended. The file is complete when no process has it open
+//                  for writing (a complete file is read once), when a line starts with
+//                  --trailer <text>, or after --follow_timeout <s> seconds without new data
+//                  (default 300; 0 waits forever). On network filesystems, where writers
+//                  can't be seen, a close followed by a second without growth ends it too.
+//   --semijoin     Parse the smaller file first and skip value parsing for rows of the
+//                  larger file whose keys a Bloom filter of the smaller file's keys rules out.
+//                  Not allowed with --snapshot, which needs every value.
+//   --oneshot1, --oneshot2
+//                  Read file1/file2 without leaving it in the page cache: ranges are read
+//                  ahead with WILLNEED and dropped with DONTNEED once parsed, so a huge
+//                  one-shot input doesn't evict the golden file or other jobs' data.
+//   --json_report <path>
+//                  Also write the summary as JSON, including the memory breakdown: live and
+//                  peak bytes and allocation counts of keys, raw values, per-chunk maps,
+//                  merged maps, sorted key lists and the dictionary after each phase.
+//   --nearest <max_dist> --xycol1 <x,y> --xycol2 <x,y> [--cellcol1 <c> --cellcol2 <c>]
+//                  Pair the instances left unmatched in both files by placement: each
+//                  leftover of file1 is matched to the nearest leftover of file2 within
+//                  max_dist (with the same cell type, if cell columns are given). Pairs are
+//                  written to location_matches.csv and dropped from missing_instances.txt.
+//                  (Rows whose values --semijoin skipped are listed without a value.)
+//   --suggest <max_edits> [--qgram <q>]
+//                  For each key still missing from file2, suggest the closest key missing
+//                  from file1 within max_edits edits (e.g. '_reg' -> '_reg_0'), found via a
+//                  q-gram index (q = 3 by default). Written to suggested_matches.csv.
+//   --missing_format full|grouped|collapsed
+//                  'grouped' writes missing_instances.txt front-coded: keys are listed under
+//                  their '/'-separated hierarchy prefixes, each printed once with the number
+//                  of missing keys below it. 'collapsed' also writes a subtree none of whose
+//                  instances matched as a single 'prefix/* (count, ...)' entry.
+//   --presence_only
+//                  Only find the matched and missing keys: each line is kept as a 16-byte
+//                  key hash and line offset, values are not read and comparison.csv is not
+//                  written. Equal hashes are confirmed against the key bytes of both files,
+//                  so the inputs should still be in the page cache after the parse: options
+//                  that need values (--valexpr1/2, --units, --lazy_raw, --tolerances, ...)
+//                  and --oneshot1/--oneshot2 are rejected.
+//   --sample <p>   Quick triage: compare only the fraction p of the keys whose hash falls
+//                  below p * 2^64 (the same keys in both files) and print estimated counts
+//                  for the full files and |deviation| quantiles, with 95% confidence
+//                  intervals. With --index and valid indexes showing both files sorted by
+//                  key, whole index blocks are sampled and only those parts are read.
+//   --tolerances <file>
+//                  Per-hierarchy limits: lines of '<pattern> [abs=<x>] [rel=<y>[%]]', where
+//                  a pattern is a key prefix, '*<text>*' for a substring or '*' for the
+//                  default. Limits may also be 'sig=<digits>' (agreement to that many
+//                  significant digits) and 'ulp=<n>' (units in the last printed place with
+//                  --comparison_type decimal, otherwise of the double format). Each
+//                  matched key takes its longest matching pattern, and comparison.csv gains
+//                  Tolerance_Rule and Within_Tolerance columns.
+//   --normalize <rules>, --normalize1 <rules>, --normalize2 <rules>
+//                  Rewrite the instance keys of both files (or of one) before matching.
+//                  Rules are comma-separated: strip_prefix=<p> (a leading prefix as spelled
+//                  in the file), unescape ('\[3\]' -> '[3]'), divider=<a><b> (e.g. 'divider=./'
+//                  turns 'u1.u2' into 'u1/u2') and fold_case. Outputs show the rewritten keys.
+//   --history <dir>
+//                  Append this run's per-instance results to the history store in dir
+//                  (created if missing), for the history subcommand.
+//   --snapshot <dir>
+//                  Save the parsed keys and raw values of both files as numbered snapshots
+//                  in dir (created if missing), indexed for the lookup subcommand. A file
+//                  already snapshotted with the same size, mtime and parse options (columns,
+//                  --valexpr, --where, --normalize, --delim) is skipped.
+//   --threads <n>  Parse each file with n threads (default: one per hardware thread).
+//   --fast_exit    Flush outputs and exit right after the summary without tearing down
+//                  the parsed data structures (the OS reclaims the memory).
+//
+// Subcommands:
+//   ./comparer profile --file <path> [--instcol <cols>]
+//       One parallel pass over the file reporting line counts, the column count
+//       distribution, key lengths, per-column numeric ratios and an estimate of the
+//       number of distinct keys. Machine-readable results are printed as PROFILE_STATS lines.
+//   ./comparer fetch --file <path> --key <key>
+//       Prints the original line(s) for an instance key, reading only the blocks of the
+//       sidecar index (built by a run with --index) whose key range can contain it.
+//   ./comparer microbench --file <path> [--valcol <col>] [--delim <d>] [--repeat <n>] [--max_mb <mb>]
+//       Times each specialized parse kernel (1-4 key columns x numeric/string/raw/decimal
+//       values) against the generic one on the head of the file and reports the speedups.
+//   ./comparer bench --file1 ... --file2 ... [--threads 1,2,4,...] [--repeat <n>] [options]
+//       Runs the full comparison for each thread count, with the inputs evicted from the
+//       page cache (cold, via fadvise; no root needed) and cached (warm), and tabulates
+//       throughput, speedup, parallel efficiency, per-phase times and the I/O-bound share.
+//       Machine-readable results are printed as BENCH_STATS lines.
+//   ./comparer history --dir <dir> [--prefix <p>] [--last <n>] [--regressed <n> [--min_change <pct>]] [--threads <n>]
+//       Queries the runs appended with --history. Without a query it lists the runs. With
+//       --prefix it prints the deviation series of every instance under the prefix, one
+//       column per run (the last n runs with --last). --regressed n lists the instances
+//       whose absolute deviation grew by more than min_change points between the run n
+//       runs back and the newest one. Only the needed columns and blocks are read, in parallel.
+//   ./comparer lookup --dir <dir> [--key <k1,k2,...>] [--keys_file <path>] [--prefix <p>] [--threads <n>]
+//       Prints the value of each key (or of every key under the prefix) in every snapshot
+//       saved with --snapshot, from the snapshots' memory-mapped hash and sorted indexes
+//       instead of the text files. --keys_file holds one key per line for batch lookups.
+//
 // If run without arguments, it will enter interactive mode.
 
 #include <iostream>
@@ -25,311 +154,5958 @@
 #include <sstream>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <future>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cerrno>
+#include <type_traits>
+#include <array>
+#include <optional>
+#include <charconv>
+#include <iomanip>
+#include <limits>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/file.h>
+#include <dirent.h>
+#include <sys/vfs.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-// A variant to hold either a numeric value (double) or a string value.
-using ValueVariant = std::variant<double, std::string>;
+// Copies the bytes of `s` into `mr` and returns a view of the copy.
+inline std::string_view intern(std::pmr::memory_resource& mr, std::string_view s) {
+    char* p = static_cast<char*>(mr.allocate(s.size() ? s.size() : 1, 1));
+    std::memcpy(p, s.data(), s.size());
+    return {p, s.size()};
+}
 
-// The main data structure to hold the parsed data for each instance.
-// Key: A single string representing the combined instance key (e.g., "inst1|partA").
-// Value: A pair containing the raw string value and the parsed ValueVariant.
-using InstanceDataMap = std::unordered_map<std::string, std::pair<std::string, ValueVariant>>;
+// Bump-pointer region allocator. Everything allocated from an Arena (container nodes,
+// buckets, key and value bytes) is released in one go when the Arena is destroyed;
+// individual deallocations are no-ops. An Arena is not thread-safe: each worker owns one.
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(size_t block_size = 16u << 20) : block_size_(block_size) {}
+    ~Arena() override {
+        for (void* block : blocks_) std::free(block);
+    }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
 
-// A set to hold the unique instance keys for fast lookups.
-using InstanceSet = std::unordered_set<std::string>;
+    // Copies the bytes of `s` into the arena and returns a view of the copy.
+    std::string_view intern(std::string_view s) { return ::intern(*this, s); }
 
-// Set of keywords to identify metadata lines that should be skipped.
-const std::unordered_set<std::string> METADATA_KEYWORDS = {
-    "VERSION", "CREATION", "CREATOR", "PROGRAM", "DIVIDERCHAR", "DESIGN",
-    "UNITS", "INSTANCE_COUNT", "NOMINAL_VOLTAGE", "POWER_NET", "GROUND_NET",
-    "WINDOW", "RP_VALUE", "RP_FORMAT", "RP_INST_LIMIT", "RP_THRESHOLD",
-    "RP_PIN_NAME", "MICRON_UNITS", "INST_NAME"
-};
+    // Constructs a T inside the arena. Its destructor is never run; its memory
+    // goes away with the arena.
+    template <typename T, typename... Args>
+    T& make(Args&&... args) {
+        return *new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
 
-// Splits a string by a delimiter.
-std::vector<std::string> split(const std::string& s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+    size_t bytes_reserved() const { return bytes_reserved_; }
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        uintptr_t p = (cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        if (p + bytes > end_) {
+            size_t size = std::max(block_size_, bytes + align);
+            void* block = std::malloc(size);
+            if (!block) throw std::bad_alloc();
+            blocks_.push_back(block);
+            bytes_reserved_ += size;
+            cur_ = reinterpret_cast<uintptr_t>(block);
+            end_ = cur_ + size;
+            p = (cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur_ = p + bytes;
+        return reinterpret_cast<void*>(p);
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
     }
-    return tokens;
-}
 
-// Finds chunk boundaries in a file, ensuring chunks end on a newline.
-std::vector<std::pair<long long, long long>> find_chunk_boundaries(const std::string& file_path, unsigned int num_chunks) {
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file) {
-        std::cerr << "❌ Error: Cannot open file '" << file_path << "'" << std::endl;
-        return {};
+    size_t block_size_;
+    uintptr_t cur_ = 0;
+    uintptr_t end_ = 0;
+    size_t bytes_reserved_ = 0;
+    std::vector<void*> blocks_;
+};
+
+// The structures whose memory is accounted separately in the summary.
+enum class MemCategory { Keys, RawValues, ChunkTables, MergedTables, KeyLists, Dictionary, Count };
+constexpr size_t kMemCategories = static_cast<size_t>(MemCategory::Count);
+constexpr const char* kMemCategoryNames[kMemCategories] = {
+    "keys", "raw values", "per-chunk maps", "merged maps", "sorted key lists", "dictionary"};
+
+// Forwards to an upstream resource (an Arena) and counts what one structure allocates:
+// live bytes, the peak of live bytes and the number of allocations. Deallocations are
+// counted even though the arena doesn't reclaim them, so "live" is what the structure
+// still uses and the arena total minus live is what it has abandoned (rehashes, merged
+// chunk maps). Like an Arena, an instance is used by one thread at a time.
+class TrackedResource : public std::pmr::memory_resource {
+public:
+    TrackedResource(std::pmr::memory_resource* upstream, MemCategory category)
+        : upstream_(upstream), category_(category) {}
+
+    MemCategory category() const { return category_; }
+    size_t live() const { return live_; }
+    size_t peak() const { return peak_; }
+    size_t allocations() const { return allocations_; }
+    void reset_peak() { peak_ = live_; }
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        live_ += bytes;
+        peak_ = std::max(peak_, live_);
+        ++allocations_;
+        return upstream_->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        live_ -= bytes;
+        upstream_->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
     }
 
-    long long file_size = file.tellg();
-    if (file_size == 0) return {};
+    std::pmr::memory_resource* upstream_;
+    MemCategory category_;
+    size_t live_ = 0;
+    size_t peak_ = 0;
+    size_t allocations_ = 0;
+};
 
-    std::vector<std::pair<long long, long long>> boundaries;
-    long long chunk_size = file_size / num_chunks;
-    long long current_pos = 0;
+// The tracked resources one parse worker allocates from, all backed by its own arena.
+struct WorkerMemory {
+    TrackedResource* keys;
+    TrackedResource* raw_values;
+    TrackedResource* tables;
+};
 
-    for (unsigned int i = 0; i < num_chunks; ++i) {
-        long long start = current_pos;
-        long long end = (i == num_chunks - 1) ? file_size : start + chunk_size;
+// Memory of each structure category at the end of one phase of a run. Peaks are summed
+// over the per-thread resources, so they bound the true simultaneous peak from above.
+struct MemPhase {
+    std::string name;
+    std::array<size_t, kMemCategories> live{}, peak{}, allocations{};
+    size_t arena_reserved = 0;
+    double seconds = 0;  // wall time of the phase
+};
 
-        file.seekg(end);
-        std::string dummy;
-        std::getline(file, dummy); // Read until newline
-        end = file.tellg();
-        if (end >= file_size || end == -1) {
-            end = file_size;
-        }
+// Owns all arenas of a run: one for the main thread plus one per parse worker.
+// Destroying the Region frees every block without visiting individual objects.
+// It also keeps the tracked resources handed out over its arenas, so the memory of
+// each structure can be reported per phase.
+class Region {
+public:
+    Arena& main() { return main_; }
+    Arena& new_arena(size_t block_size = 16u << 20) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arenas_.push_back(std::make_unique<Arena>(block_size));
+        return *arenas_.back();
+    }
+    size_t bytes_reserved() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = main_.bytes_reserved();
+        for (const auto& a : arenas_) total += a->bytes_reserved();
+        return total;
+    }
 
-        if (start < end) {
-            boundaries.push_back({start, end});
+    // A resource over `arena` whose allocations are counted under `category`.
+    TrackedResource& tracked(Arena& arena, MemCategory category) {
+        TrackedResource& mr = arena.make<TrackedResource>(&arena, category);
+        std::lock_guard<std::mutex> lock(mutex_);
+        tracked_.push_back(&mr);
+        return mr;
+    }
+    // A fresh arena for one parse worker; its maps are counted under `tables`.
+    WorkerMemory new_worker(MemCategory tables = MemCategory::ChunkTables) {
+        Arena& arena = new_arena();
+        return {&tracked(arena, MemCategory::Keys), &tracked(arena, MemCategory::RawValues),
+                &tracked(arena, tables)};
+    }
+
+    // Records the time and the memory of every category at the end of phase `name` and
+    // starts the peaks of the next phase at the current live bytes. Call it between
+    // phases, when no worker is allocating. The first phase starts with the Region.
+    void end_phase(const std::string& name) {
+        MemPhase phase;
+        phase.name = name;
+        auto now = std::chrono::steady_clock::now();
+        phase.seconds = std::chrono::duration<double>(now - phase_start_).count();
+        phase_start_ = now;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (TrackedResource* mr : tracked_) {
+                size_t c = static_cast<size_t>(mr->category());
+                phase.live[c] += mr->live();
+                phase.peak[c] += mr->peak();
+                phase.allocations[c] += mr->allocations();
+                mr->reset_peak();
+            }
         }
-        current_pos = end;
-        if (current_pos >= file_size) break;
+        phase.arena_reserved = bytes_reserved();
+        phases_.push_back(std::move(phase));
     }
-    return boundaries;
+    const std::vector<MemPhase>& phases() const { return phases_; }
+
+private:
+    Arena main_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Arena>> arenas_;
+    std::vector<TrackedResource*> tracked_;
+    std::vector<MemPhase> phases_;
+    std::chrono::steady_clock::time_point phase_start_ = std::chrono::steady_clock::now();
+};
+
+// 64-bit hash of a byte range (multiply-xorshift over 8-byte words). Chaining calls
+// through `seed` hashes a sequence of fields; the length is mixed in, so field
+// boundaries are part of the hash.
+inline uint64_t hash_bytes(const char* p, size_t n, uint64_t seed = 0) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (seed ^ (n * k)) + 0x632BE59BD9B4E019ull;
+    while (n >= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ (w * k)) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    if (n) {
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = (h ^ (w * k)) * 0xBF58476D1CE4E5B9ull;
+    }
+    h ^= h >> 32;
+    h *= 0x94D049BB133111EBull;
+    return h ^ (h >> 29);
 }
 
-// The core worker function executed by each thread.
-std::pair<InstanceDataMap, InstanceSet> process_chunk(
-    const std::string file_path,
-    long long start_byte,
-    long long end_byte,
-    const std::vector<int> inst_cols,
-    int value_col
-) {
-    InstanceDataMap data;
-    InstanceSet instances_set;
-    int max_col = 0;
-    for (int col : inst_cols) max_col = std::max(max_col, col);
-    max_col = std::max(max_col, value_col);
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
 
-    std::ifstream file(file_path, std::ios::binary);
-    file.seekg(start_byte);
+inline bool get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        v |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
 
-    std::string line;
-    while (file.tellg() < end_byte && std::getline(file, line)) {
-        if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+// Number of bytes put_varint() uses for `v`.
+inline size_t varint_size(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
 
-        std::stringstream ss(line);
-        std::string first_word;
-        ss >> first_word;
-        if (METADATA_KEYWORDS.count(first_word)) continue;
+inline char* put_varint(char* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
 
-        std::vector<std::string> parts;
-        std::string part;
-        // Reset stringstream to parse the full line
-        ss.clear();
-        ss.seekg(0);
-        while (ss >> part) {
-            parts.push_back(part);
-        }
+// Code of a string value in the StringDictionary (--dict_values).
+struct DictCode {
+    uint32_t code;
+};
 
-        if (parts.size() <= max_col) continue;
+// A decimal read exactly (--comparison_type decimal): digits * 10^exponent. Trailing zeros
+// are stripped from `digits`, so equal values have equal fields however they are spelled
+// ('0.1', '0.10000', '1e-1'); `last_place` is the exponent of the last printed digit, the
+// value's unit in the last place.
+struct Decimal {
+    int64_t digits = 0;
+    int32_t exponent = 0;
+    int32_t last_place = 0;
+};
 
-        try {
-            std::string key_str;
-            for (size_t i = 0; i < inst_cols.size(); ++i) {
-                key_str += parts.at(inst_cols[i]);
-                if (i < inst_cols.size() - 1) key_str += "|"; // Delimiter
-            }
+// A variant to hold either a numeric value (double or exact decimal) or a string value.
+// String values are views into the arena that owns the raw value bytes, or
+// dictionary codes with --dict_values.
+using ValueVariant = std::variant<double, std::string_view, DictCode, Decimal>;
 
-            std::string raw_val = parts.at(value_col);
-            ValueVariant val_parsed;
-            try {
-                val_parsed = std::stod(raw_val);
-            } catch (const std::invalid_argument&) {
-                val_parsed = raw_val;
-            }
+// The raw text of a value: either a view of its bytes in an arena, or (with --lazy_raw)
+// only its position in the input file, packed as a 40-bit offset and 24-bit length, until
+// rehydrate_raw_values() resolves it for output.
+class RawValue {
+public:
+    static constexpr uint64_t kMaxOffset = (uint64_t(1) << 40) - 1;
+    static constexpr uint64_t kMaxLength = (uint64_t(1) << 24) - 1;
 
-            data[key_str] = {raw_val, val_parsed};
-            instances_set.insert(key_str);
-        } catch (const std::out_of_range&) {
-            continue;
-        }
+    RawValue() = default;
+    RawValue(std::string_view text) : data_(text.data()), bits_(text.size()) {}
+    static RawValue in_file(uint64_t offset, uint64_t length) {
+        RawValue r;
+        r.bits_ = (offset << 24) | length;
+        return r;
     }
-    return {data, instances_set};
-}
 
-// Orchestrates the parallel parsing of a file.
-std::pair<InstanceDataMap, InstanceSet> parallel_parse_file(
-    const std::string& file_path,
-    const std::vector<int>& inst_cols,
-    int value_col
-) {
-    unsigned int num_workers = std::thread::hardware_concurrency();
-    std::cout << "\nParsing " << file_path << " with " << num_workers << " workers..." << std::endl;
+    bool resolved() const { return data_ != nullptr || bits_ == 0; }
+    std::string_view text() const { return resolved() ? std::string_view(data_, bits_) : std::string_view(); }
+    uint64_t file_offset() const { return bits_ >> 24; }
+    uint64_t file_length() const { return bits_ & kMaxLength; }
 
-    auto chunks = find_chunk_boundaries(file_path, num_workers);
-    if (chunks.empty()) {
-        std::cout << "Warning: File " << file_path << " is empty or could not be read." << std::endl;
-        return {};
+private:
+    const char* data_ = nullptr;
+    uint64_t bits_ = 0; // length if data_ is set, otherwise offset << 24 | length
+};
+
+// Key of an instance, made of one or more key columns.
+//
+// A stored key is the canonical encoding of its fields in an arena: a varint field count,
+// a varint length per field, then the fields joined with '|' (the display form). Fields
+// may contain '|' themselves without two different splits colliding. A probe key refers
+// to the raw field spans of the line being parsed, so lookups need no copy; a key is only
+// materialized into an arena when it is new. Both kinds carry the same field-wise hash.
+class InstanceKey {
+public:
+    InstanceKey() = default;
+
+    // A probe over `count` field spans, which must outlive the probe.
+    InstanceKey(const std::string_view* fields, uint32_t count)
+        : ptr_(fields), size_(count), probe_(true), hash_(hash_fields(fields, count)) {}
+
+    static uint64_t hash_fields(const std::string_view* fields, uint32_t count) {
+        uint64_t h = count;
+        for (uint32_t i = 0; i < count; ++i) h = hash_bytes(fields[i].data(), fields[i].size(), h);
+        return h;
     }
 
-    std::vector<std::future<std::pair<InstanceDataMap, InstanceSet>>> futures;
-    for (const auto& chunk : chunks) {
-        futures.push_back(std::async(std::launch::async, process_chunk, file_path, chunk.first, chunk.second, inst_cols, value_col));
+    // Copies a probe's fields into `mr` in the canonical encoding.
+    static InstanceKey materialize(const InstanceKey& probe, std::pmr::memory_resource& mr) {
+        const auto* fields = static_cast<const std::string_view*>(probe.ptr_);
+        size_t size = varint_size(probe.size_) + (probe.size_ ? probe.size_ - 1 : 0);
+        for (uint32_t i = 0; i < probe.size_; ++i) size += varint_size(fields[i].size()) + fields[i].size();
+        char* out = static_cast<char*>(mr.allocate(size, 1));
+        char* p = put_varint(out, probe.size_);
+        for (uint32_t i = 0; i < probe.size_; ++i) p = put_varint(p, fields[i].size());
+        for (uint32_t i = 0; i < probe.size_; ++i) {
+            if (i) *p++ = '|';
+            std::memcpy(p, fields[i].data(), fields[i].size());
+            p += fields[i].size();
+        }
+        InstanceKey key;
+        key.ptr_ = out;
+        key.size_ = static_cast<uint32_t>(size);
+        key.hash_ = probe.hash_;
+        return key;
     }
 
-    InstanceDataMap final_data;
-    InstanceSet final_instances_set;
-    for (auto& fut : futures) {
-        auto result = fut.get();
-        final_data.insert(result.first.begin(), result.first.end());
-        final_instances_set.insert(result.second.begin(), result.second.end());
+    uint64_t hash() const { return hash_; }
+
+    // The fields joined with '|'. Only for stored keys.
+    std::string_view display() const {
+        const char* p = bytes();
+        uint64_t n = read_varint(p);
+        for (uint64_t i = 0; i < n; ++i) read_varint(p);
+        return std::string_view(p, bytes() + size_ - p);
     }
 
-    return {final_data, final_instances_set};
-}
+    void append_display(std::string& out) const {
+        if (!probe_) {
+            out += display();
+            return;
+        }
+        const auto* fields = static_cast<const std::string_view*>(ptr_);
+        for (uint32_t i = 0; i < size_; ++i) {
+            if (i) out += '|';
+            out += fields[i];
+        }
+    }
 
-// Writes the comparison CSV file.
-void write_comparison_csv(
-    const std::string& file1_name, const std::string& file2_name,
-    const InstanceDataMap& data1, const InstanceDataMap& data2,
-    const std::vector<std::string>& matched
-) {
-    std::cout << "Writing comparison.csv..." << std::endl;
-    std::ofstream csvfile("comparison.csv");
-    csvfile << "Key,Value_" << file1_name << ",Value_" << file2_name << ",Difference,Deviation_Match\n";
+    bool operator==(const InstanceKey& o) const {
+        if (hash_ != o.hash_) return false;
+        if (!probe_ && !o.probe_) return size_ == o.size_ && std::memcmp(ptr_, o.ptr_, size_) == 0;
+        if (probe_ && o.probe_) {
+            const auto* a = static_cast<const std::string_view*>(ptr_);
+            const auto* b = static_cast<const std::string_view*>(o.ptr_);
+            return size_ == o.size_ && std::equal(a, a + size_, b);
+        }
+        return probe_ ? o.equals_probe(*this) : equals_probe(o);
+    }
 
-    for (const auto& key : matched) {
-        const auto& pair1 = data1.at(key);
-        const auto& pair2 = data2.at(key);
+private:
+    const char* bytes() const { return static_cast<const char*>(ptr_); }
 
-        csvfile << key << "," << pair1.first << "," << pair2.first << ",";
+    static uint64_t read_varint(const char*& p) {
+        uint64_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(*p++);
+            v |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return v;
+        }
+    }
 
-        if (std::holds_alternative<double>(pair1.second) && std::holds_alternative<double>(pair2.second)) {
-            double val1 = std::get<double>(pair1.second);
-            double val2 = std::get<double>(pair2.second);
-            double diff = val1 - val2;
-            csvfile << diff << ",";
-            if (val2 != 0) {
-                csvfile << (diff / val2) * 100 << "%";
-            } else {
-                csvfile << "inf";
-            }
-        } else {
-            csvfile << "N/A," << (pair1.first == pair2.first ? "YES" : "NO");
+    // Compares this stored key with a probe, field by field.
+    bool equals_probe(const InstanceKey& probe) const {
+        const auto* fields = static_cast<const std::string_view*>(probe.ptr_);
+        const char* p = bytes();
+        if (read_varint(p) != probe.size_) return false;
+        for (uint32_t i = 0; i < probe.size_; ++i) {
+            if (read_varint(p) != fields[i].size()) return false;
         }
-        csvfile << "\n";
+        for (uint32_t i = 0; i < probe.size_; ++i) {
+            if (std::memcmp(p, fields[i].data(), fields[i].size()) != 0) return false;
+            p += fields[i].size() + 1;
+        }
+        return true;
     }
-}
 
-// Writes the missing instances file.
-void write_missing_file(
-    const std::string& file1_name, const std::string& file2_name,
-    const std::vector<std::string>& miss2, const std::vector<std::string>& miss1
-) {
-    std::ofstream out("missing_instances.txt");
-    out << "============================================================\n";
-    out << "Instances missing from " << file2_name << ":\n";
-    out << "============================================================\n";
-    for (const auto& inst : miss2) out << inst << "\n";
+    const void* ptr_ = nullptr;
+    uint32_t size_ = 0; // bytes of the encoding, or the number of fields of a probe
+    bool probe_ = false;
+    uint64_t hash_ = 0;
+};
 
-    out << "\n============================================================\n";
-    out << "Instances missing from " << file1_name << ":\n";
-    out << "============================================================\n";
-    for (const auto& inst : miss1) out << inst << "\n";
-}
+struct InstanceKeyHash {
+    size_t operator()(const InstanceKey& k) const noexcept { return static_cast<size_t>(k.hash()); }
+};
 
+// Orders keys by their display form, the order of the output files.
+inline bool key_display_less(const InstanceKey& a, const InstanceKey& b) { return a.display() < b.display(); }
 
-int main(int argc, char* argv[]) {
-    std::unordered_map<std::string, std::string> args;
-    // Simple argument parsing
-    for (int i = 1; i < argc; i += 2) {
-        if (i + 1 < argc) {
-            args[argv[i]] = argv[i + 1];
+inline std::ostream& operator<<(std::ostream& os, const InstanceKey& k) { return os << k.display(); }
+
+// The main data structure to hold the parsed data for each instance.
+// Key: The instance key (displayed as e.g. "inst1|partA").
+// Value: A pair containing the raw string value and the parsed ValueVariant.
+// Keys, values and nodes all live in an Arena.
+using InstanceDataMap = std::pmr::unordered_map<InstanceKey, std::pair<RawValue, ValueVariant>, InstanceKeyHash>;
+
+// A set to hold the unique instance keys for fast lookups.
+using InstanceSet = std::pmr::unordered_set<InstanceKey, InstanceKeyHash>;
+
+// Sorted lists of matched/missing keys, viewing the keys stored in the maps.
+using KeyList = std::pmr::vector<InstanceKey>;
+
+// Set of keywords to identify metadata lines that should be skipped.
+const std::unordered_set<std::string> METADATA_KEYWORDS = {
+    "VERSION", "CREATION", "CREATOR", "PROGRAM", "DIVIDERCHAR", "DESIGN",
+    "UNITS", "INSTANCE_COUNT", "NOMINAL_VOLTAGE", "POWER_NET", "GROUND_NET",
+    "WINDOW", "RP_VALUE", "RP_FORMAT", "RP_INST_LIMIT", "RP_THRESHOLD",
+    "RP_PIN_NAME", "MICRON_UNITS", "INST_NAME"
+};
+
+// The same keywords as views, for lookups on tokens that are not std::strings.
+const std::unordered_set<std::string_view> METADATA_KEYWORD_VIEWS(METADATA_KEYWORDS.begin(), METADATA_KEYWORDS.end());
+
+// Concurrent dictionary of the distinct string values of the compared columns. Both
+// files share one dictionary, so equal strings get equal 32-bit codes. The table is split
+// into shards, each with its own lock and arena; the low bits of a code name the shard.
+class StringDictionary {
+public:
+    static constexpr unsigned kShardBits = 6;
+    static constexpr size_t kShards = size_t(1) << kShardBits;
+
+    explicit StringDictionary(Region& region) {
+        for (auto& shard : shards_) {
+            Arena& arena = region.new_arena(1u << 20);
+            shard.mr = &region.tracked(arena, MemCategory::Dictionary);
+            shard.codes = &arena.make<std::pmr::unordered_map<std::string_view, uint32_t>>(shard.mr);
         }
     }
 
-    // Interactive mode if arguments are missing
-    if (args.find("--file1") == args.end()) {
-        std::cout << "Entering interactive mode...\n";
-        std::cout << "Enter path to first file: ";
-        std::cin >> args["--file1"];
-        std::cout << "Enter instance match column indexes (e.g., 0,1) for file1: ";
-        std::cin >> args["--instcol1"];
-        std::cout << "Enter value column index for file1: ";
-        std::cin >> args["--valcol1"];
-        std::cout << "Enter path to second file: ";
-        std::cin >> args["--file2"];
-        std::cout << "Enter instance match column indexes (e.g., 0,1) for file2: ";
-        std::cin >> args["--instcol2"];
-        std::cout << "Enter value column index for file2: ";
-        std::cin >> args["--valcol2"];
+    // Returns the code of `s` and a view of the dictionary's copy of it.
+    std::pair<DictCode, std::string_view> encode(std::string_view s) {
+        uint64_t h = hash_bytes(s.data(), s.size());
+        Shard& shard = shards_[h & (kShards - 1)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.codes->find(s);
+        if (it == shard.codes->end()) {
+            uint32_t code = (shard.next++ << kShardBits) | static_cast<uint32_t>(h & (kShards - 1));
+            it = shard.codes->emplace(intern(*shard.mr, s), code).first;
+        }
+        return {DictCode{it->second}, it->first};
     }
 
-    std::vector<int> instcol1, instcol2;
-    int valcol1, valcol2;
-    try {
-        std::stringstream ss1(args["--instcol1"]);
-        std::string segment;
-        while(std::getline(ss1, segment, ',')) instcol1.push_back(std::stoi(segment));
+    size_t size() {
+        size_t n = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            n += shard.codes->size();
+        }
+        return n;
+    }
 
-        std::stringstream ss2(args["--instcol2"]);
-        while(std::getline(ss2, segment, ',')) instcol2.push_back(std::stoi(segment));
+private:
+    struct Shard {
+        std::mutex mutex;
+        TrackedResource* mr = nullptr;
+        std::pmr::unordered_map<std::string_view, uint32_t>* codes = nullptr;
+        uint32_t next = 0;
+    };
+    Shard shards_[kShards];
+};
 
-        valcol1 = std::stoi(args["--valcol1"]);
-        valcol2 = std::stoi(args["--valcol2"]);
-    } catch (const std::exception& e) {
-        std::cerr << "❌ Error: Invalid column arguments. Please provide comma-separated integers." << std::endl;
-        return 1;
+// Blocked Bloom filter over 64-bit key hashes. All probe bits of a key fall in one
+// 512-bit block, so a lookup touches a single cache line. ~10 bits per key gives about a
+// 1% false positive rate.
+class BloomFilter {
+public:
+    explicit BloomFilter(size_t expected_keys, size_t bits_per_key = 10)
+        : num_blocks_(std::max<size_t>(1, (expected_keys * bits_per_key + 511) / 512)),
+          words_(num_blocks_ * 8, 0) {}
+
+    void add(uint64_t h) {
+        uint64_t* block = block_for(h);
+        uint64_t bits = remix(h);
+        for (int i = 0; i < kProbes; ++i, bits >>= 9) block[(bits & 511) >> 6] |= uint64_t(1) << (bits & 63);
+    }
+
+    bool may_contain(uint64_t h) const {
+        const uint64_t* block = const_cast<BloomFilter*>(this)->block_for(h);
+        uint64_t bits = remix(h);
+        for (int i = 0; i < kProbes; ++i, bits >>= 9) {
+            if (!(block[(bits & 511) >> 6] & (uint64_t(1) << (bits & 63)))) return false;
+        }
+        return true;
     }
-    
-    auto t_start = std::chrono::high_resolution_clock::now();
 
-    auto result1 = parallel_parse_file(args["--file1"], instcol1, valcol1);
-    auto result2 = parallel_parse_file(args["--file2"], instcol2, valcol2);
+    size_t bytes() const { return words_.size() * sizeof(uint64_t); }
 
-    InstanceDataMap data1 = result1.first;
-    InstanceSet instances1 = result1.second;
-    InstanceDataMap data2 = result2.first;
-    InstanceSet instances2 = result2.second;
+private:
+    static constexpr int kProbes = 6;
 
-    std::cout << "\nComparing data..." << std::endl;
-    std::vector<std::string> missing_in_file2, missing_in_file1, matched_instances;
-    for (const auto& inst : instances1) {
-        if (instances2.count(inst)) {
-            matched_instances.push_back(inst);
-        } else {
-            missing_in_file2.push_back(inst);
+    uint64_t* block_for(uint64_t h) {
+        size_t block = static_cast<size_t>(((h >> 32) * static_cast<uint64_t>(num_blocks_)) >> 32);
+        return &words_[block * 8];
+    }
+    static uint64_t remix(uint64_t h) {
+        h *= 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 31);
+    }
+
+    size_t num_blocks_;
+    std::vector<uint64_t> words_;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) return;
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) return;
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) return;
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (p == MAP_FAILED) {
+            size_ = 0;
+            return;
         }
+        data_ = static_cast<const char*>(p);
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+    }
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return fd_ >= 0; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    int fd() const { return fd_; }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Field separators: space and \t \n \v \f \r, the same set `operator>>` skips.
+inline bool is_blank(char c) { return c == ' ' || (static_cast<unsigned char>(c) - 9u) <= 4u; }
+
+// Returns the first byte in [p, end) that is blank (kBlank) or non-blank (!kBlank),
+// or `end`. `limit` bounds the readable memory and allows 16-byte loads past `end`.
+template <bool kBlank>
+inline const char* find_blank_class(const char* p, const char* end, const char* limit) {
+#if defined(__SSE2__)
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4);
+    while (p < end && p + 16 <= limit) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ctl = _mm_sub_epi8(v, tab); // '\t'..'\r' map to 0..4
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl));
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(m));
+        if (!kBlank) bits = ~bits & 0xFFFFu;
+        if (bits) return std::min(end, p + __builtin_ctz(bits));
+        p += 16;
+    }
+#endif
+    while (p < end && is_blank(*p) != kBlank) ++p;
+    return std::min(p, end);
+}
+
+// Splits the line [begin, end) on blanks, storing up to `max_fields` fields.
+// Returns the total number of fields on the line, which may exceed `max_fields`.
+inline size_t tokenize_line(const char* begin, const char* end, const char* limit,
+                            std::string_view* fields, size_t max_fields) {
+    size_t n = 0;
+    const char* p = find_blank_class<false>(begin, end, limit);
+    while (p < end) {
+        const char* q = find_blank_class<true>(p, end, limit);
+        if (n < max_fields) fields[n] = std::string_view(p, q - p);
+        ++n;
+        p = find_blank_class<false>(q, end, limit);
     }
-    for (const auto& inst : instances2) {
-        if (!instances1.count(inst)) {
-            missing_in_file1.push_back(inst);
+    return n;
+}
+
+// True if the whole token is a decimal or scientific number.
+inline bool is_numeric_token(std::string_view tok) {
+    if (!tok.empty() && tok[0] == '+') tok.remove_prefix(1);
+    if (tok.empty()) return false;
+    double v;
+    auto res = std::from_chars(tok.data(), tok.data() + tok.size(), v);
+    return res.ec == std::errc() && res.ptr == tok.data() + tok.size();
+}
+
+// Field delimiter of the input files (--delim).
+enum class Delimiter { Whitespace, Comma, Tab };
+
+// Splits the line [begin, end) into at most `max_fields` fields and returns how many were
+// stored. Whitespace runs of blanks form one separator; comma and tab separate single
+// fields (empty fields are kept, a trailing CR is dropped).
+template <Delimiter D>
+inline size_t split_fields(const char* begin, const char* end, const char* limit,
+                           std::string_view* fields, size_t max_fields) {
+    size_t n = 0;
+    if constexpr (D == Delimiter::Whitespace) {
+        const char* p = find_blank_class<false>(begin, end, limit);
+        while (p < end && n < max_fields) {
+            const char* q = find_blank_class<true>(p, end, limit);
+            fields[n++] = std::string_view(p, q - p);
+            p = find_blank_class<false>(q, end, limit);
+        }
+    } else {
+        constexpr char sep = D == Delimiter::Comma ? ',' : '\t';
+        if (end > begin && end[-1] == '\r') --end;
+        const char* p = begin;
+        while (n < max_fields) {
+            const char* q = static_cast<const char*>(std::memchr(p, sep, end - p));
+            if (!q) {
+                fields[n++] = std::string_view(p, end - p);
+                break;
+            }
+            fields[n++] = std::string_view(p, q - p);
+            p = q + 1;
         }
     }
-    std::sort(missing_in_file1.begin(), missing_in_file1.end());
-    std::sort(missing_in_file2.begin(), missing_in_file2.end());
-    std::sort(matched_instances.begin(), matched_instances.end());
+    return n;
+}
 
-    std::cout << "Writing output files..." << std::endl;
-    std::string f1_basename = args["--file1"].substr(args["--file1"].find_last_of("/\\") + 1);
-    std::string f2_basename = args["--file2"].substr(args["--file2"].find_last_of("/\\") + 1);
+enum class NumParse { Ok, NotNumber, OutOfRange };
 
-    write_missing_file(f1_basename, f2_basename, missing_in_file2, missing_in_file1);
-    if (!matched_instances.empty()) {
-        write_comparison_csv(f1_basename, f2_basename, data1, data2, matched_instances);
+// Parses a leading number exactly like std::stod (so "12.5mV" reads as 12.5), but
+// reports failures as a status instead of throwing and needs no allocation.
+inline NumParse parse_number(std::string_view tok, double& out) {
+    char small[64];
+    std::string big;
+    const char* s;
+    if (tok.size() < sizeof(small)) {
+        std::memcpy(small, tok.data(), tok.size());
+        small[tok.size()] = '\0';
+        s = small;
     } else {
-        std::cout << "Note: No matched instances found; comparison.csv will be empty." << std::endl;
+        big.assign(tok);
+        s = big.c_str();
     }
+    char* endp;
+    errno = 0;
+    out = std::strtod(s, &endp);
+    if (endp == s) return NumParse::NotNumber;
+    if (errno == ERANGE) return NumParse::OutOfRange;
+    return NumParse::Ok;
+}
 
-    auto t_end = std::chrono::high_resolution_clock::now();
-    double elapsed_time_ms = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+// Scale of an SI prefix letter, or 0 if `c` is none. 'u' stands for micro and 'K' is
+// accepted for kilo.
+inline double si_prefix_scale(char c) {
+    switch (c) {
+        case 'a': return 1e-18;
+        case 'f': return 1e-15;
+        case 'p': return 1e-12;
+        case 'n': return 1e-9;
+        case 'u': return 1e-6;
+        case 'm': return 1e-3;
+        case 'k': case 'K': return 1e3;
+        case 'M': return 1e6;
+        case 'G': return 1e9;
+        case 'T': return 1e12;
+        case 'P': return 1e15;
+        default: return 0;
+    }
+}
 
-    std::cout << "\n===================================\n";
-    std::cout << "✅ All tasks completed.\n";
-    std::cout << "===================================\n";
-    std::cout << "Instances in " << f1_basename << ": " << instances1.size() << "\n";
-    std::cout << "Instances in " << f2_basename << ": " << instances2.size() << "\n";
-    std::cout << "Matched Instances: " << matched_instances.size() << "\n";
-    std::cout << "Missing from " << f2_basename << ": " << missing_in_file2.size() << "\n";
-    std::cout << "Missing from " << f1_basename << ": " << missing_in_file1.size() << "\n";
-    std::cout << "\nTotal execution time: " << elapsed_time_ms / 1000.0 << " seconds\n";
+// Units that may follow a number, with or without an SI prefix. A suffix made of a prefix
+// letter alone ('5m') is read as the prefix.
+inline bool is_known_unit(std::string_view u) {
+    static const std::string_view kUnits[] = {"V", "A", "W", "s", "S", "Hz", "F", "H", "Ohm", "ohm", "\xCE\xA9", "C", "J"};
+    return std::find(std::begin(kUnits), std::end(kUnits), u) != std::end(kUnits);
+}
 
-    return 0;
+// Reads the first number of a value decorated with a label or unit ('12.5mV', '0.83(V)',
+// 'I=3.2uA', '10Kohm') and scales it by the SI prefix of the unit that follows it. The
+// number must start a word, so the '1' of 'V1=0.5' is skipped. A suffix that is neither a
+// known unit nor a prefix plus one ('dB', 'Pa') leaves the number unscaled.
+inline NumParse parse_scaled_number(std::string_view tok, double& out) {
+    const char* p = tok.data();
+    const char* end = p + tok.size();
+    auto is_digit = [](char c) { return static_cast<unsigned>(c - '0') <= 9; };
+    auto is_word = [&](char c) { return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_'; };
+    const char* num = nullptr;
+    for (const char* q = p; q < end; ++q) {
+        const char* d = q + (*q == '-' || *q == '+');
+        d += d < end && *d == '.';
+        if (d < end && is_digit(*d) && (q == p || !is_word(q[-1]))) {
+            num = q;
+            break;
+        }
+        if (is_word(*q)) {
+            while (q + 1 < end && is_word(q[1])) ++q;  // skip the rest of a word
+        }
+    }
+    if (!num) return NumParse::NotNumber;
+    num += *num == '+';
+    auto res = std::from_chars(num, end, out);
+    if (res.ec == std::errc::result_out_of_range) return NumParse::OutOfRange;
+    if (res.ec != std::errc()) return NumParse::NotNumber;
+
+    // The unit: letters (and UTF-8 bytes) after the number, possibly in parentheses.
+    p = res.ptr;
+    p += p < end && *p == '(';
+    const char* unit_start = p;
+    while (p < end && (((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z') || static_cast<unsigned char>(*p) >= 0x80)) ++p;
+    std::string_view unit(unit_start, p - unit_start);
+    if (unit.empty() || is_known_unit(unit)) return NumParse::Ok;
+    double scale = 0;
+    size_t prefix_len = 1;
+    if (unit.rfind("\xC2\xB5", 0) == 0 || unit.rfind("\xCE\xBC", 0) == 0) {  // micro sign, Greek mu
+        scale = 1e-6;
+        prefix_len = 2;
+    } else if (unit.rfind("meg", 0) == 0 || unit.rfind("Meg", 0) == 0 || unit.rfind("MEG", 0) == 0) {
+        scale = 1e6;
+        prefix_len = 3;
+    } else {
+        scale = si_prefix_scale(unit[0]);
+    }
+    std::string_view rest = unit.substr(prefix_len);
+    if (scale != 0 && (rest.empty() || is_known_unit(rest))) out *= scale;
+    return NumParse::Ok;
+}
+
+// ---------------------------------------------------------------------------
+// Exact decimals (--comparison_type decimal)
+// ---------------------------------------------------------------------------
+
+// True if the 8 bytes at `p` are all digits; `value` is then their number (the first
+// byte is the most significant digit). SWAR: one range check and three multiplies.
+inline bool parse_8_digits(const char* p, uint64_t& value) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    if (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) != 0x3333333333333333ull) return false;
+    v = ((v & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+    v = ((v & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+    value = ((v & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+    return true;
+}
+
+// Appends a run of digits to `acc`, 8 at a time where possible. Returns the number of
+// digits read, or -1 if `acc` would exceed 18 digits.
+inline int scan_digits(const char*& p, const char* end, uint64_t& acc) {
+    const char* start = p;
+    uint64_t chunk;
+    while (end - p >= 8 && parse_8_digits(p, chunk)) {
+        if (acc >= 10000000000ull) return -1;
+        acc = acc * 100000000 + chunk;
+        p += 8;
+    }
+    for (; p < end && static_cast<unsigned>(*p - '0') <= 9; ++p) {
+        if (acc >= 100000000000000000ull) return -1;
+        acc = acc * 10 + static_cast<unsigned>(*p - '0');
+    }
+    return static_cast<int>(p - start);
+}
+
+// Reads a whole token as an exact decimal: [+-]digits[.digits][(e|E)[+-]digits] with at
+// most 18 significant digits. Returns false for anything else (units, '0x', 'nan', more
+// digits), which the caller parses as a double instead.
+inline bool parse_decimal(std::string_view tok, Decimal& out) {
+    const char* p = tok.data();
+    const char* end = p + tok.size();
+    bool negative = p < end && *p == '-';
+    p += p < end && (*p == '-' || *p == '+');
+    // Leading zeros add no digits, so '0.000123' stays well within 18 digits.
+    const char* int_start = p;
+    while (p < end && *p == '0') ++p;
+    uint64_t digits = 0;
+    if (scan_digits(p, end, digits) < 0) return false;
+    bool any = p > int_start;
+    int frac_digits = 0;
+    if (p < end && *p == '.') {
+        const char* frac_start = ++p;
+        if (digits == 0) {
+            while (p < end && *p == '0') ++p;
+        }
+        if (scan_digits(p, end, digits) < 0) return false;
+        frac_digits = static_cast<int>(p - frac_start);
+        any |= frac_digits > 0;
+    }
+    if (!any) return false;
+    int exponent = 0;
+    if (p < end && (*p | 0x20) == 'e') {
+        ++p;
+        bool exp_negative = p < end && *p == '-';
+        p += p < end && (*p == '-' || *p == '+');
+        uint64_t e = 0;
+        if (scan_digits(p, end, e) <= 0 || e > 400) return false;
+        exponent = exp_negative ? -static_cast<int>(e) : static_cast<int>(e);
+    }
+    if (p != end) return false;
+
+    out.last_place = exponent - frac_digits;
+    out.exponent = out.last_place;
+    while (digits && digits % 10 == 0) {
+        digits /= 10;
+        ++out.exponent;
+    }
+    if (!digits) out.exponent = 0;
+    out.digits = negative ? -static_cast<int64_t>(digits) : static_cast<int64_t>(digits);
+    return true;
+}
+
+// The nearest double to a decimal. For digits below 2^53 and |exponent| <= 22 both operands
+// are exact doubles and one multiply or divide rounds correctly; other values go through
+// strtod.
+inline double decimal_to_double(const Decimal& d) {
+    static constexpr double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (d.digits > -(int64_t(1) << 53) && d.digits < (int64_t(1) << 53) && d.exponent >= -22 && d.exponent <= 22) {
+        double m = static_cast<double>(d.digits);
+        return d.exponent >= 0 ? m * kPow10[d.exponent] : m / kPow10[-d.exponent];
+    }
+    char buf[48];
+    char* q = std::to_chars(buf, buf + 24, d.digits).ptr;
+    *q++ = 'e';
+    *std::to_chars(q, buf + sizeof(buf) - 1, d.exponent).ptr = '\0';
+    return std::strtod(buf, nullptr);
+}
+
+// The value as a double, if it is a number.
+inline bool numeric_value(const ValueVariant& v, double& out) {
+    if (const double* d = std::get_if<double>(&v)) {
+        out = *d;
+        return true;
+    }
+    if (const Decimal* d = std::get_if<Decimal>(&v)) {
+        out = decimal_to_double(*d);
+        return true;
+    }
+    return false;
+}
+
+using int128 = __int128;
+
+// 10^n for n up to 38, the largest power of ten in 128 bits.
+inline int128 pow10_128(int n) {
+    int128 p = 1;
+    while (n-- > 0) p *= 10;
+    return p;
+}
+
+// Two decimals scaled to their common (smaller) exponent: a * 10^exponent, b * 10^exponent.
+struct AlignedDecimals {
+    int128 a = 0, b = 0;
+    int32_t exponent = 0;
+
+    // Fails if the exponents are more than 20 apart, which could overflow 128 bits.
+    bool align(const Decimal& x, const Decimal& y) {
+        exponent = std::min(x.exponent, y.exponent);
+        if (std::max(x.exponent, y.exponent) - exponent > 20) return false;
+        a = x.digits * pow10_128(x.exponent - exponent);
+        b = y.digits * pow10_128(y.exponent - exponent);
+        return true;
+    }
+};
+
+// Plain notation of digits * 10^exponent: '-0.00125', '1500', '0'.
+std::string format_decimal(int128 digits, int32_t exponent) {
+    if (digits == 0) return "0";
+    bool negative = digits < 0;
+    unsigned __int128 u = negative ? -static_cast<unsigned __int128>(digits) : static_cast<unsigned __int128>(digits);
+    std::string text;
+    do {
+        text.push_back(static_cast<char>('0' + static_cast<int>(u % 10)));
+        u /= 10;
+    } while (u);
+    while (exponent < 0 && text.size() > 1 && text[0] == '0') {
+        text.erase(0, 1);
+        ++exponent;
+    }
+    std::reverse(text.begin(), text.end());
+    if (exponent > 0) {
+        if (text != "0") text.append(exponent, '0');
+    } else if (exponent < 0) {
+        size_t frac = static_cast<size_t>(-exponent);
+        if (text.size() <= frac) text.insert(0, frac - text.size() + 1, '0');
+        text.insert(text.size() - frac, 1, '.');
+    }
+    return negative ? "-" + text : text;
+}
+
+// Agreement to `n` significant digits: the difference is at most half a unit of the n-th
+// digit of the larger magnitude.
+inline bool within_sig_digits(double a, double b, int n) {
+    double m = std::max(std::fabs(a), std::fabs(b));
+    if (m == 0 || a == b) return true;
+    return std::fabs(a - b) <= 0.5 * std::pow(10.0, std::floor(std::log10(m)) - n + 1);
+}
+
+// The same for two exact decimals, on their scaled integers.
+inline bool within_sig_digits(const AlignedDecimals& d, int n) {
+    int128 diff = d.a > d.b ? d.a - d.b : d.b - d.a;
+    if (diff == 0) return true;
+    // The place of the leading digit of the larger magnitude, in units of 10^d.exponent.
+    int128 larger = std::max(d.a < 0 ? -d.a : d.a, d.b < 0 ? -d.b : d.b);
+    int lead = -1;
+    for (int128 m = larger; m; m /= 10) ++lead;
+    int k = lead - n + 1;  // pass if 2 * diff <= 10^k
+    if (k < 0) return false;
+    if (k > 38) return true;
+    return 2 * diff <= pow10_128(k);
+}
+
+// At most `n` representable doubles apart.
+inline bool within_ulps(double a, double b, uint64_t n) {
+    auto ordered = [](double v) {
+        uint64_t u;
+        std::memcpy(&u, &v, 8);
+        return u >> 63 ? ~u : u | (uint64_t(1) << 63);
+    };
+    if (a == b) return true;
+    if (std::isnan(a) || std::isnan(b)) return false;
+    uint64_t x = ordered(a), y = ordered(b);
+    return (x > y ? x - y : y - x) <= n;
+}
+
+// At most `n` units in the last printed place of the less precise value apart.
+inline bool within_ulps(const Decimal& x, const Decimal& y, const AlignedDecimals& d, uint64_t n) {
+    int128 diff = d.a > d.b ? d.a - d.b : d.b - d.a;
+    if (diff == 0) return true;
+    // 10^38 is the largest power of ten in 128 bits. A product that overflows is larger
+    // than any diff (or n), which decides the comparison without it.
+    int place = std::max(x.last_place, y.last_place) - d.exponent;
+    int128 scaled;
+    if (place < 0) return -place <= 38 && !__builtin_mul_overflow(diff, pow10_128(-place), &scaled) && scaled <= n;
+    if (place > 38) return n > 0;
+    return __builtin_mul_overflow(static_cast<int128>(n), pow10_128(place), &scaled) || diff <= scaled;
+}
+
+// HyperLogLog distinct-count sketch with 2^14 registers (~0.8% standard error).
+class HyperLogLog {
+public:
+    static constexpr int kPrecision = 14;
+    HyperLogLog() : registers_(size_t(1) << kPrecision, 0) {}
+
+    void add(uint64_t hash) {
+        size_t idx = hash >> (64 - kPrecision);
+        uint64_t rest = (hash << kPrecision) | (uint64_t(1) << (kPrecision - 1));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if (rank > registers_[idx]) registers_[idx] = rank;
+    }
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < registers_.size(); ++i)
+            registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+    double estimate() const {
+        const double m = static_cast<double>(registers_.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers_) {
+            sum += std::ldexp(1.0, -r);
+            zeros += (r == 0);
+        }
+        double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        if (e <= 2.5 * m && zeros) e = m * std::log(m / zeros);
+        return e;
+    }
+
+private:
+    std::vector<uint8_t> registers_;
+};
+
+// Splits a string by a delimiter.
+std::vector<std::string> split(const std::string& s, char delimiter) {
+    std::vector<std::string> tokens;
+    std::string token;
+    std::istringstream tokenStream(s);
+    while (std::getline(tokenStream, token, delimiter)) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+// ---------------------------------------------------------------------------
+// Sidecar line index
+// ---------------------------------------------------------------------------
+//
+// '<file>.cidx' records, for every block of up to `stride` consecutive lines, the byte
+// offset of its first line, its line and key counts, and the min/max instance key seen in
+// it. Offsets are delta-encoded as varints. The index is only trusted if the file's size
+// and modification time still match the header.
+
+struct IndexBlock {
+    uint64_t offset = 0;
+    uint64_t lines = 0;
+    uint64_t keys = 0;
+    std::string key_min;
+    std::string key_max;
+};
+
+struct LineIndex {
+    uint64_t file_size = 0;
+    int64_t file_mtime_ns = 0;
+    uint64_t stride = 0;
+    std::vector<int> inst_cols;
+    std::vector<IndexBlock> blocks;
+
+    uint64_t total_lines() const {
+        uint64_t n = 0;
+        for (const auto& b : blocks) n += b.lines;
+        return n;
+    }
+};
+
+constexpr char kIndexMagic[8] = {'C', 'M', 'P', 'I', 'D', 'X', '0', '1'};
+
+inline std::string index_path_for(const std::string& file_path) { return file_path + ".cidx"; }
+
+inline bool get_bytes(const char*& p, const char* end, std::string& out) {
+    uint64_t n;
+    if (!get_varint(p, end, n) || n > static_cast<uint64_t>(end - p)) return false;
+    out.assign(p, n);
+    p += n;
+    return true;
+}
+
+// Size and modification time of a file, used to detect stale sidecars.
+inline bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime_ns) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    size = static_cast<uint64_t>(st.st_size);
+    mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool write_line_index(const std::string& file_path, const LineIndex& index) {
+    std::string out(kIndexMagic, sizeof(kIndexMagic));
+    put_varint(out, index.file_size);
+    put_varint(out, static_cast<uint64_t>(index.file_mtime_ns));
+    put_varint(out, index.stride);
+    put_varint(out, index.inst_cols.size());
+    for (int c : index.inst_cols) put_varint(out, static_cast<uint64_t>(c));
+    put_varint(out, index.blocks.size());
+    uint64_t prev_offset = 0;
+    for (const auto& b : index.blocks) {
+        put_varint(out, b.offset - prev_offset);
+        prev_offset = b.offset;
+        put_varint(out, b.lines);
+        put_varint(out, b.keys);
+        put_varint(out, b.key_min.size());
+        out += b.key_min;
+        put_varint(out, b.key_max.size());
+        out += b.key_max;
+    }
+    std::ofstream f(index_path_for(file_path), std::ios::binary | std::ios::trunc);
+    f.write(out.data(), out.size());
+    return static_cast<bool>(f);
+}
+
+// Loads the sidecar index of `file_path`. Returns false if it is missing, corrupt or stale.
+bool load_line_index(const std::string& file_path, LineIndex& index) {
+    std::ifstream f(index_path_for(file_path), std::ios::binary);
+    if (!f) return false;
+    std::string buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    if (buf.size() < sizeof(kIndexMagic) || std::memcmp(buf.data(), kIndexMagic, sizeof(kIndexMagic)) != 0) return false;
+
+    const char* p = buf.data() + sizeof(kIndexMagic);
+    const char* end = buf.data() + buf.size();
+    uint64_t mtime, ncols, nblocks;
+    if (!get_varint(p, end, index.file_size) || !get_varint(p, end, mtime) ||
+        !get_varint(p, end, index.stride) || !get_varint(p, end, ncols)) return false;
+    index.file_mtime_ns = static_cast<int64_t>(mtime);
+    index.inst_cols.clear();
+    for (uint64_t i = 0; i < ncols; ++i) {
+        uint64_t c;
+        if (!get_varint(p, end, c)) return false;
+        index.inst_cols.push_back(static_cast<int>(c));
+    }
+    if (!get_varint(p, end, nblocks)) return false;
+    index.blocks.clear();
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < nblocks; ++i) {
+        IndexBlock b;
+        uint64_t delta;
+        if (!get_varint(p, end, delta) || !get_varint(p, end, b.lines) || !get_varint(p, end, b.keys) ||
+            !get_bytes(p, end, b.key_min) || !get_bytes(p, end, b.key_max)) return false;
+        offset += delta;
+        b.offset = offset;
+        index.blocks.push_back(std::move(b));
+    }
+
+    uint64_t size;
+    int64_t mtime_ns;
+    return stat_file(file_path, size, mtime_ns) && size == index.file_size && mtime_ns == index.file_mtime_ns;
+}
+
+// Splits the file into chunks holding equal numbers of lines, cutting at index blocks.
+std::vector<std::pair<long long, long long>> chunk_boundaries_from_index(const LineIndex& index, unsigned int num_chunks) {
+    std::vector<std::pair<long long, long long>> boundaries;
+    uint64_t total = index.total_lines();
+    if (index.blocks.empty() || total == 0) return boundaries;
+
+    long long start = 0;
+    uint64_t seen = 0;
+    unsigned int chunk = 1;
+    for (const auto& b : index.blocks) {
+        uint64_t target = total * chunk / num_chunks;
+        if (seen >= target && static_cast<long long>(b.offset) > start) {
+            boundaries.push_back({start, static_cast<long long>(b.offset)});
+            start = static_cast<long long>(b.offset);
+            while (chunk < num_chunks && seen >= total * chunk / num_chunks) ++chunk;
+        }
+        seen += b.lines;
+    }
+    boundaries.push_back({start, static_cast<long long>(index.file_size)});
+    return boundaries;
+}
+
+// Finds chunk boundaries in a file, ensuring chunks end on a newline.
+std::vector<std::pair<long long, long long>> find_chunk_boundaries(const std::string& file_path, unsigned int num_chunks) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "❌ Error: Cannot open file '" << file_path << "'" << std::endl;
+        return {};
+    }
+
+    long long file_size = file.tellg();
+    if (file_size == 0) return {};
+
+    std::vector<std::pair<long long, long long>> boundaries;
+    long long chunk_size = file_size / num_chunks;
+    long long current_pos = 0;
+
+    for (unsigned int i = 0; i < num_chunks; ++i) {
+        long long start = current_pos;
+        long long end = (i == num_chunks - 1) ? file_size : start + chunk_size;
+
+        file.seekg(end);
+        std::string dummy;
+        std::getline(file, dummy); // Read until newline
+        end = file.tellg();
+        if (end >= file_size || end == -1) {
+            end = file_size;
+        }
+
+        if (start < end) {
+            boundaries.push_back({start, end});
+        }
+        current_pos = end;
+        if (current_pos >= file_size) break;
+    }
+    return boundaries;
+}
+
+// How values are kept (--comparison_type, --lazy_raw).
+//   Numeric: parse numbers, keep a copy of the raw text; non-numbers stay strings.
+//   String:  no number parsing; values compare as text.
+//   Raw:     like Numeric, but only the raw text's file position is kept.
+//   Decimal: values that are plain decimals are kept exactly as scaled integers; others
+//            are parsed like Numeric.
+enum class ValueMode { Numeric, String, Raw, Decimal };
+
+// Declarative rewrite rules for instance keys (--normalize), for files whose tools spell
+// the same instance differently. Rules apply to each key field before it is hashed or
+// copied into the arena, so normalized keys match, hash and print alike:
+//   strip_prefix=<p>  drop a leading prefix, as spelled in the file (e.g. a top module)
+//   unescape          drop the backslash of escaped characters ('\[3\]' -> '[3]')
+//   divider=<a><b>    translate hierarchy divider a into b (e.g. 'divider=./')
+//   fold_case         fold letters to lower case
+// A field no rule rewrites stays a view into the read buffer: the cost is one vectorized
+// scan for bytes a rule would rewrite.
+struct KeyNormalizer {
+    std::string strip_prefix;
+    bool unescape = false;
+    char divider_from = 0, divider_to = 0;  // 0 = no translation
+    bool fold_case = false;
+
+    // Parses a comma-separated rule list. Returns false on an unknown or malformed rule.
+    bool parse(const std::string& spec) {
+        for (const auto& rule : split(spec, ',')) {
+            if (rule.rfind("strip_prefix=", 0) == 0 && rule.size() > 13) {
+                strip_prefix = rule.substr(13);
+            } else if (rule == "unescape") {
+                unescape = true;
+            } else if (rule.rfind("divider=", 0) == 0 && rule.size() == 10) {
+                divider_from = rule[8];
+                divider_to = rule[9];
+            } else if (rule == "fold_case") {
+                fold_case = true;
+            } else if (!rule.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Normalizes one key field. The prefix is stripped by narrowing the view; if another
+    // rule fires, the rewritten bytes (never more than the field's) go to `out` and the view
+    // points there. Returns the number of bytes of `out` used.
+    size_t apply(std::string_view& field, char* out) const {
+        if (!strip_prefix.empty() && field.size() >= strip_prefix.size() &&
+            std::memcmp(field.data(), strip_prefix.data(), strip_prefix.size()) == 0) {
+            field.remove_prefix(strip_prefix.size());
+        }
+        const char* begin = field.data();
+        const char* end = begin + field.size();
+        const char* p = find_rewrite(begin, end);
+        if (p == end) return 0;
+
+        std::memcpy(out, begin, p - begin);
+        char* o = out + (p - begin);
+        for (; p < end; ++p) {
+            char c = *p;
+            if (unescape && c == '\\' && p + 1 < end) {
+                *o++ = *++p;  // the escaped character is taken literally
+                continue;
+            }
+            if (c == divider_from && divider_from) c = divider_to;
+            if (fold_case && c >= 'A' && c <= 'Z') c = static_cast<char>(c + ('a' - 'A'));
+            *o++ = c;
+        }
+        field = std::string_view(out, o - out);
+        return field.size();
+    }
+
+private:
+    // The first byte in [p, end) that a rule rewrites, or `end`.
+    const char* find_rewrite(const char* p, const char* end) const {
+#if defined(__SSE2__)
+        const __m128i backslash = _mm_set1_epi8(unescape ? '\\' : 0);
+        const __m128i divider = _mm_set1_epi8(divider_from);
+        // Upper-case letters: c - 'A' < 26 as unsigned bytes, tested with a signed compare
+        // after biasing by -128.
+        const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80 + 'A'));
+        const __m128i upper_bound = _mm_set1_epi8(static_cast<char>(-128 + 26));
+        const __m128i fold = _mm_set1_epi8(fold_case ? -1 : 0);
+        const __m128i zero = _mm_setzero_si128();
+        while (p + 16 <= end) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, divider));
+            __m128i upper = _mm_cmpgt_epi8(upper_bound, _mm_sub_epi8(v, bias));
+            m = _mm_or_si128(m, _mm_and_si128(upper, fold));
+            // A zero divider or backslash pattern would match NUL bytes; keys have none.
+            m = _mm_andnot_si128(_mm_cmpeq_epi8(v, zero), m);
+            unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(m));
+            if (bits) return p + __builtin_ctz(bits);
+            p += 16;
+        }
+#endif
+        for (; p < end; ++p) {
+            char c = *p;
+            if ((unescape && c == '\\') || (divider_from && c == divider_from) || (fold_case && c >= 'A' && c <= 'Z')) return p;
+        }
+        return end;
+    }
+};
+
+// A derived value (--valexpr1/--valexpr2) or row predicate (--where1/--where2): an
+// arithmetic expression over the numeric columns of a line and the numeric header
+// constants of its file, e.g. 'col4 + col5', 'max(col4, col5) / NOMINAL_VOLTAGE' or
+// 'value > 0.05 * NOMINAL_VOLTAGE and col5 > 0'. Columns are numbered like --valcol;
+// comparisons, 'and' and 'or' give 1 or 0. The expression is compiled once into register
+// bytecode: slots hold the input columns, then the constants, then temporaries reused as
+// soon as they are consumed. Parsers gather the referenced columns of a batch of lines in
+// columnar form and run() applies each instruction to the whole batch in one tight loop.
+class ValueExpr {
+public:
+    static constexpr size_t kBatch = 256;
+    static constexpr int kValueColumn = -1;  // 'value', the compared value of the line
+    static constexpr int kMaxColumn = 65535; // highest colN; parsers keep a field per column
+
+    // Compiles `text`, resolving names against `constants`; `value` may be used if
+    // `allow_value` is set. On failure returns false with a message in `error`.
+    bool compile(const std::string& text, const std::unordered_map<std::string, double>& constants,
+                 bool allow_value, std::string& error) {
+        text_ = text;
+        pos_ = 0;
+        constants_ = &constants;
+        allow_value_ = allow_value;
+        error_.clear();
+        Operand result = parse_or();
+        skip_blanks();
+        if (error_.empty() && pos_ < text_.size()) fail("unexpected '" + text_.substr(pos_, 1) + "'");
+        if (error_.empty() && columns_.empty()) error_ = "the expression uses no column";
+        if (!error_.empty()) {
+            error = "'" + text + "': " + error_;
+            return false;
+        }
+        // Slots so far count columns and temporaries; constants go between them.
+        result_ = result.constant ? constant_slot(result.value) : result.slot;
+        for (auto& ins : code_) {
+            ins.dst = remap(ins.dst);
+            ins.a = remap(ins.a);
+            ins.b = remap(ins.b);
+        }
+        result_ = remap(result_);
+        return true;
+    }
+
+    // Referenced columns (kValueColumn for 'value'); column i of a batch goes in slot i.
+    const std::vector<int>& columns() const { return columns_; }
+    int max_column() const { return *std::max_element(columns_.begin(), columns_.end()); }
+
+    // Column slot i of batch row `row`.
+    static double& input(std::vector<double>& slots, size_t i, size_t row) { return slots[i * kBatch + row]; }
+
+    // Sizes the slots of a batch and fills the constant slots.
+    void init_slots(std::vector<double>& slots) const {
+        slots.assign((columns_.size() + const_values_.size() + temps_) * kBatch, 0);
+        for (size_t c = 0; c < const_values_.size(); ++c) {
+            std::fill_n(&slots[(columns_.size() + c) * kBatch], kBatch, const_values_[c]);
+        }
+    }
+
+    // Evaluates the first `n` lines of a batch whose column slots are filled; returns the
+    // results.
+    const double* run(std::vector<double>& slots, size_t n) const {
+        double* base = slots.data();
+        for (const auto& ins : code_) {
+            double* d = base + ins.dst * kBatch;
+            const double* a = base + ins.a * kBatch;
+            const double* b = base + ins.b * kBatch;
+            switch (ins.op) {
+                case Op::Add: for (size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+                case Op::Sub: for (size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+                case Op::Mul: for (size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+                case Op::Div: for (size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+                case Op::Neg: for (size_t i = 0; i < n; ++i) d[i] = -a[i]; break;
+                case Op::Abs: for (size_t i = 0; i < n; ++i) d[i] = std::fabs(a[i]); break;
+                // NaN (an unreadable column) wins, so it is not hidden by the other operand.
+                case Op::Min: for (size_t i = 0; i < n; ++i) d[i] = a[i] != a[i] || a[i] < b[i] ? a[i] : b[i]; break;
+                case Op::Max: for (size_t i = 0; i < n; ++i) d[i] = a[i] != a[i] || a[i] > b[i] ? a[i] : b[i]; break;
+                case Op::Lt: for (size_t i = 0; i < n; ++i) d[i] = a[i] < b[i]; break;
+                case Op::Le: for (size_t i = 0; i < n; ++i) d[i] = a[i] <= b[i]; break;
+                case Op::Gt: for (size_t i = 0; i < n; ++i) d[i] = a[i] > b[i]; break;
+                case Op::Ge: for (size_t i = 0; i < n; ++i) d[i] = a[i] >= b[i]; break;
+                case Op::Eq: for (size_t i = 0; i < n; ++i) d[i] = a[i] == b[i]; break;
+                case Op::Ne: for (size_t i = 0; i < n; ++i) d[i] = a[i] != b[i]; break;
+                case Op::And: for (size_t i = 0; i < n; ++i) d[i] = a[i] != 0 && b[i] != 0 && a[i] == a[i] && b[i] == b[i]; break;
+                case Op::Or: for (size_t i = 0; i < n; ++i) d[i] = (a[i] != 0 && a[i] == a[i]) || (b[i] != 0 && b[i] == b[i]); break;
+            }
+        }
+        return base + result_ * kBatch;
+    }
+
+private:
+    enum class Op : uint8_t { Add, Sub, Mul, Div, Neg, Abs, Min, Max, Lt, Le, Gt, Ge, Eq, Ne, And, Or };
+    struct Instr {
+        Op op;
+        uint32_t dst, a, b;
+    };
+    // A compile-time value: a constant (folded) or a slot.
+    struct Operand {
+        bool constant = false;
+        double value = 0;
+        uint32_t slot = 0;
+    };
+
+    // While compiling, slots below kTempBase are columns, then constants from kConstBase
+    // and temporaries from kTempBase; remap() packs them once their counts are known.
+    static constexpr uint32_t kConstBase = 1u << 16, kTempBase = 1u << 24;
+
+    uint32_t remap(uint32_t slot) const {
+        if (slot >= kTempBase) return static_cast<uint32_t>(columns_.size() + const_values_.size()) + (slot - kTempBase);
+        if (slot >= kConstBase) return static_cast<uint32_t>(columns_.size()) + (slot - kConstBase);
+        return slot;
+    }
+
+    uint32_t constant_slot(double v) {
+        for (size_t c = 0; c < const_values_.size(); ++c) {
+            if (std::memcmp(&const_values_[c], &v, sizeof(v)) == 0) return kConstBase + static_cast<uint32_t>(c);
+        }
+        const_values_.push_back(v);
+        return kConstBase + static_cast<uint32_t>(const_values_.size() - 1);
+    }
+
+    uint32_t slot_of(const Operand& x) { return x.constant ? constant_slot(x.value) : x.slot; }
+    void release(const Operand& x) {
+        if (!x.constant && x.slot >= kTempBase) free_.push_back(x.slot);
+    }
+    uint32_t new_temp() {
+        if (!free_.empty()) {
+            uint32_t t = free_.back();
+            free_.pop_back();
+            return t;
+        }
+        return kTempBase + static_cast<uint32_t>(temps_++);
+    }
+
+    // Emits `op` on the operands, or folds it if they are constants.
+    Operand emit(Op op, const Operand& x, const Operand& y) {
+        if (x.constant && y.constant) {
+            double a = x.value, b = y.value;
+            switch (op) {
+                case Op::Add: return {true, a + b};
+                case Op::Sub: return {true, a - b};
+                case Op::Mul: return {true, a * b};
+                case Op::Div: return {true, a / b};
+                case Op::Neg: return {true, -a};
+                case Op::Abs: return {true, std::fabs(a)};
+                case Op::Min: return {true, a != a || a < b ? a : b};
+                case Op::Max: return {true, a != a || a > b ? a : b};
+                case Op::Lt: return {true, double(a < b)};
+                case Op::Le: return {true, double(a <= b)};
+                case Op::Gt: return {true, double(a > b)};
+                case Op::Ge: return {true, double(a >= b)};
+                case Op::Eq: return {true, double(a == b)};
+                case Op::Ne: return {true, double(a != b)};
+                case Op::And: return {true, double(a != 0 && b != 0 && a == a && b == b)};
+                case Op::Or: return {true, double((a != 0 && a == a) || (b != 0 && b == b))};
+            }
+        }
+        uint32_t a = slot_of(x), b = slot_of(y);
+        release(x);
+        if (y.constant || y.slot != x.slot) release(y);  // unary ops pass x twice
+        Operand out;
+        out.slot = new_temp();
+        code_.push_back({op, out.slot, a, b});
+        return out;
+    }
+
+    void fail(const std::string& message) {
+        if (error_.empty()) error_ = message + " at offset " + std::to_string(pos_);
+    }
+    void skip_blanks() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+    }
+    bool accept(char c) {
+        skip_blanks();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    // Accepts the keyword `word` if it is next as a whole word.
+    bool accept_word(const char* word) {
+        skip_blanks();
+        size_t n = std::strlen(word);
+        if (text_.compare(pos_, n, word) != 0) return false;
+        if (pos_ + n < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[pos_ + n])) || text_[pos_ + n] == '_')) return false;
+        pos_ += n;
+        return true;
+    }
+
+    Operand parse_or() {
+        Operand x = parse_and();
+        while (error_.empty() && accept_word("or")) x = emit(Op::Or, x, parse_and());
+        return x;
+    }
+    Operand parse_and() {
+        Operand x = parse_comparison();
+        while (error_.empty() && accept_word("and")) x = emit(Op::And, x, parse_comparison());
+        return x;
+    }
+    Operand parse_comparison() {
+        Operand x = parse_sum();
+        skip_blanks();
+        static const std::pair<const char*, Op> kOps[] = {
+            {"<=", Op::Le}, {">=", Op::Ge}, {"==", Op::Eq}, {"!=", Op::Ne}, {"<", Op::Lt}, {">", Op::Gt}};
+        for (const auto& op : kOps) {
+            size_t n = std::strlen(op.first);
+            if (text_.compare(pos_, n, op.first) == 0) {
+                pos_ += n;
+                return emit(op.second, x, parse_sum());
+            }
+        }
+        return x;
+    }
+    Operand parse_sum() {
+        Operand x = parse_product();
+        for (;;) {
+            if (accept('+')) x = emit(Op::Add, x, parse_product());
+            else if (accept('-')) x = emit(Op::Sub, x, parse_product());
+            else return x;
+        }
+    }
+    Operand parse_product() {
+        Operand x = parse_unary();
+        for (;;) {
+            if (accept('*')) x = emit(Op::Mul, x, parse_unary());
+            else if (accept('/')) x = emit(Op::Div, x, parse_unary());
+            else return x;
+        }
+    }
+    Operand parse_unary() {
+        if (accept('-')) {
+            Operand x = parse_unary();
+            return emit(Op::Neg, x, x);
+        }
+        accept('+');
+        return parse_primary();
+    }
+    Operand parse_primary() {
+        skip_blanks();
+        if (!error_.empty() || pos_ >= text_.size()) {
+            fail("expected a value");
+            return {};
+        }
+        if (accept('(')) {
+            Operand x = parse_or();
+            if (!accept(')')) fail("expected ')'");
+            return x;
+        }
+        const char* begin = text_.data() + pos_;
+        const char* end = text_.data() + text_.size();
+        if (std::isdigit(static_cast<unsigned char>(*begin)) || *begin == '.') {
+            double v = 0;
+            auto res = std::from_chars(begin, end, v);
+            if (res.ec != std::errc()) {
+                fail("bad number");
+                return {};
+            }
+            pos_ += res.ptr - begin;
+            return {true, v};
+        }
+        size_t start = pos_;
+        while (pos_ < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_')) ++pos_;
+        std::string name = text_.substr(start, pos_ - start);
+        if (name.empty()) {
+            fail("unexpected '" + text_.substr(pos_, 1) + "'");
+            return {};
+        }
+        bool is_value = allow_value_ && name == "value";
+        if (is_value || (name.size() > 3 && name.compare(0, 3, "col") == 0 && name.find_first_not_of("0123456789", 3) == std::string::npos)) {
+            int column = kValueColumn;
+            if (!is_value) {
+                auto res = std::from_chars(name.data() + 3, name.data() + name.size(), column);
+                if (res.ec != std::errc() || column > kMaxColumn) {
+                    fail("column " + name + " is out of range (at most col" + std::to_string(kMaxColumn) + ")");
+                    return {};
+                }
+            }
+            auto it = std::find(columns_.begin(), columns_.end(), column);
+            if (it == columns_.end()) it = columns_.insert(columns_.end(), column);
+            Operand x;
+            x.slot = static_cast<uint32_t>(it - columns_.begin());
+            return x;
+        }
+        if (name == "min" || name == "max" || name == "abs") {
+            if (!accept('(')) {
+                fail("expected '(' after " + name);
+                return {};
+            }
+            Operand x = parse_sum();
+            if (name == "abs") {
+                x = emit(Op::Abs, x, x);
+            } else {
+                while (error_.empty() && accept(',')) x = emit(name == "min" ? Op::Min : Op::Max, x, parse_sum());
+            }
+            if (!accept(')')) fail("expected ')'");
+            return x;
+        }
+        auto it = constants_->find(name);
+        if (it == constants_->end()) {
+            pos_ = start;
+            fail("unknown name '" + name + "' (not colN, " + (allow_value_ ? "value, " : "") +
+                 "a function or a numeric header constant of the file)");
+            return {};
+        }
+        return {true, it->second};
+    }
+
+    std::string text_;
+    size_t pos_ = 0;
+    const std::unordered_map<std::string, double>* constants_ = nullptr;
+    bool allow_value_ = false;
+    std::string error_;
+    std::vector<int> columns_;
+    std::vector<double> const_values_;
+    size_t temps_ = 0;
+    std::vector<uint32_t> free_;
+    std::vector<Instr> code_;
+    uint32_t result_ = 0;
+};
+
+// Reads the numeric header constants of a file ('NOMINAL_VOLTAGE 0.75'): metadata lines
+// before the first instance line whose second field is a number.
+std::unordered_map<std::string, double> read_header_constants(const std::string& path, Delimiter delim) {
+    std::unordered_map<std::string, double> constants;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+        std::vector<std::string> fields;
+        if (delim == Delimiter::Whitespace) {
+            std::istringstream ss(line);
+            for (std::string f; ss >> f;) fields.push_back(f);
+        } else {
+            fields = split(line, delim == Delimiter::Comma ? ',' : '\t');
+        }
+        if (fields.empty() || !METADATA_KEYWORDS.count(fields[0])) break;
+        double v;
+        if (fields.size() > 1 && parse_number(fields[1], v) == NumParse::Ok) constants[fields[0]] = v;
+    }
+    return constants;
+}
+
+// Sorted, disjoint half-open ranges [first, second) of display keys; an empty upper bound
+// is unbounded. Used by --sample to keep the keys of sampled index blocks.
+struct KeyRanges {
+    std::vector<std::pair<std::string, std::string>> ranges;
+
+    bool contains(std::string_view key) const {
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), key, [](std::string_view k, const auto& r) {
+            return k < r.first;
+        });
+        if (it == ranges.begin()) return false;
+        --it;
+        return it->second.empty() || key < it->second;
+    }
+};
+
+// Per-file parsing options.
+struct ParseOptions {
+    bool use_index = false;       // read or build the sidecar line index
+    uint64_t index_stride = 1024; // lines per index block when building
+    bool lazy_raw = false;        // keep file positions instead of raw value text
+    StringDictionary* dict = nullptr; // shared dictionary for string values (--dict_values)
+    Delimiter delim = Delimiter::Whitespace;
+    ValueMode mode = ValueMode::Numeric;
+    const BloomFilter* filter = nullptr; // keys of the other file (--semijoin), or null
+    bool oneshot = false;         // keep the file out of the page cache (--oneshot1/2)
+    unsigned workers = 0;         // parse threads per file (0 = one per hardware thread)
+    const KeyNormalizer* normalizer = nullptr; // key rewrite rules (--normalize), or null
+    bool units = false;           // read decorated values with their SI prefix (--units)
+    uint64_t sample_below = UINT64_MAX; // keep only keys hashing at or below this (--sample)
+    const KeyRanges* key_ranges = nullptr; // keep only keys in these ranges (--sample), or null
+    const std::vector<std::pair<long long, long long>>* byte_ranges = nullptr; // read only these, or null
+    const ValueExpr* expr = nullptr; // derived value instead of the value column (--valexpr1/2), or null
+    const ValueExpr* where = nullptr; // row predicate (--where1/2); failing rows only record their key
+    bool backfill = false;        // a second pass for the values of the filter's keys
+};
+
+// What one worker produces for its chunk.
+struct ChunkResult {
+    InstanceDataMap data;
+    InstanceSet instances;
+    std::vector<IndexBlock> index_blocks; // only filled when building the sidecar index
+    uint64_t filtered_rows = 0;           // rows the semi-join filter ruled out
+    bool complete = true;                 // false if a read of the chunk failed
+};
+
+// Parses instance lines into one worker's maps. Used by the chunked parallel parse and
+// by the --follow tail loop.
+//
+// The parser is instantiated per key column count (1-4; 0 means any count, known at run
+// time), delimiter and value mode, so the per-line work has no loops or branches over
+// settings that are fixed for the run. with_line_parser() picks the instantiation.
+// The column numbers themselves stay runtime members: they come from the command line
+// with no small set of common values, and the split has to find every field up to the
+// highest one anyway. Only the loops over them are fixed, as indices into a KeyCols-sized
+// array.
+template <int KeyCols, Delimiter Delim, ValueMode Mode>
+class LineParser {
+public:
+    LineParser(const std::vector<int>& inst_cols, int value_col, const WorkerMemory& mem, const ParseOptions& opts)
+        : value_col_(value_col), mem_(mem), opts_(opts),
+          data_(mem.tables), instances_(mem.tables), dict_cache_(mem.tables) {
+        max_col_ = value_col;
+        for (int col : inst_cols) max_col_ = std::max(max_col_, col);
+        if (opts.where) {
+            max_col_ = std::max(max_col_, opts.where->max_column());
+            opts.where->init_slots(where_slots_);
+        }
+        parts_.resize(max_col_ + 1);
+        if constexpr (KeyCols == 0) {
+            inst_cols_.assign(inst_cols.begin(), inst_cols.end());
+            key_fields_.resize(inst_cols.size());
+        } else {
+            std::copy_n(inst_cols.begin(), KeyCols, inst_cols_.begin());
+        }
+    }
+
+    // Parses the line [begin, end) (without its newline), which starts at byte
+    // `line_start` of the file; `limit` bounds the readable buffer. Returns a probe for the
+    // line's instance key, valid until the next call, or nullptr if the line is not an
+    // instance line.
+    const InstanceKey* parse_line(const char* begin, const char* end, const char* limit, uint64_t line_start) {
+        if (begin == end || *begin == '#' || *begin == '\r') return nullptr;
+
+        size_t num_parts = split_fields<Delim>(begin, end, limit, parts_.data(), parts_.size());
+        if (num_parts == 0 || METADATA_KEYWORD_VIEWS.count(parts_[0])) return nullptr;
+        if (num_parts <= static_cast<size_t>(max_col_)) return nullptr;
+
+        // The key is hashed straight from the field spans; its bytes are only copied
+        // into the worker's arena below if it is new.
+        for (size_t i = 0; i < key_count(); ++i) key_fields_[i] = parts_[inst_cols_[i]];
+        if (opts_.normalizer) normalize_key();
+        probe_ = InstanceKey(key_fields_.data(), static_cast<uint32_t>(key_count()));
+
+        // --sample keeps a stable subset of the keys, the same one in both files.
+        if (probe_.hash() > opts_.sample_below) return &probe_;
+        if (opts_.key_ranges) {
+            sample_key_.clear();
+            probe_.append_display(sample_key_);
+            if (!opts_.key_ranges->contains(sample_key_)) return &probe_;
+        }
+
+        // A key the other file definitely lacks can only be reported missing: record the
+        // key and skip value conversion, raw retention and the data table.
+        // (A --where backfill pass already knows its keys and records nothing.)
+        if (opts_.filter && !opts_.filter->may_contain(probe_.hash())) {
+            ++filtered_rows_;
+            if (!opts_.backfill && instances_.find(probe_) == instances_.end()) {
+                instances_.insert(InstanceKey::materialize(probe_, *mem_.keys));
+            }
+            return &probe_;
+        }
+
+        if (opts_.expr) {
+            add_expr_row();
+            return &probe_;
+        }
+
+        std::string_view raw_str = parts_[value_col_];
+        ValueVariant val_parsed = std::string_view();
+        Decimal dec;
+        if constexpr (Mode == ValueMode::Decimal) {
+            if (parse_decimal(raw_str, dec)) val_parsed = dec;
+        }
+        if (Mode != ValueMode::String && std::holds_alternative<std::string_view>(val_parsed)) {
+            double num;
+            NumParse res = opts_.units ? parse_scaled_number(raw_str, num) : parse_number(raw_str, num);
+            if (res == NumParse::OutOfRange) return &probe_;
+            if (res == NumParse::Ok) val_parsed = num;
+        }
+
+        // A row failing --where keeps only its key, for the missing-instance accounting;
+        // as the last line of its key it also drops the value of an earlier line.
+        if (opts_.where) {
+            double value;
+            if (!numeric_value(val_parsed, value)) value = std::numeric_limits<double>::quiet_NaN();
+            if (!load_where_columns(0, value)) return &probe_;
+            if (!passes(*opts_.where->run(where_slots_, 1))) {
+                auto it = data_.find(probe_);
+                if (it != data_.end()) {
+                    data_.erase(it);
+                } else if (instances_.find(probe_) == instances_.end()) {
+                    instances_.insert(InstanceKey::materialize(probe_, *mem_.keys));
+                }
+                return &probe_;
+            }
+        }
+
+        // With --lazy_raw only the value's file position is kept; string values get their
+        // text back together with the raw value at output time.
+        RawValue raw_val;
+        uint64_t raw_offset = line_start + static_cast<uint64_t>(raw_str.data() - begin);
+        bool lazy = Mode == ValueMode::Raw || ((Mode == ValueMode::String || Mode == ValueMode::Decimal) && opts_.lazy_raw);
+        if (opts_.dict && std::holds_alternative<std::string_view>(val_parsed)) {
+            // The dictionary's copy of the string doubles as the raw value.
+            auto cached = dict_cache_.find(raw_str);
+            std::pair<DictCode, std::string_view> entry;
+            if (cached != dict_cache_.end()) {
+                entry = cached->second;
+            } else {
+                entry = opts_.dict->encode(raw_str);
+                if (dict_cache_.size() < kDictCacheLimit) dict_cache_.emplace(entry.second, entry);
+            }
+            val_parsed = entry.first;
+            raw_val = entry.second;
+        } else if (lazy && raw_offset <= RawValue::kMaxOffset && raw_str.size() <= RawValue::kMaxLength) {
+            raw_val = RawValue::in_file(raw_offset, raw_str.size());
+        } else {
+            std::string_view text = intern(*mem_.raw_values, raw_str);
+            raw_val = text;
+            if (std::holds_alternative<std::string_view>(val_parsed)) val_parsed = text;
+        }
+
+        auto it = data_.find(probe_);
+        if (it != data_.end()) {
+            it->second = {raw_val, val_parsed};
+        } else {
+            InstanceKey key = InstanceKey::materialize(probe_, *mem_.keys);
+            data_.emplace(key, std::make_pair(raw_val, val_parsed));
+            instances_.insert(key);
+        }
+        return &probe_;
+    }
+
+    size_t size() const { return instances_.size(); }
+    uint64_t filtered_rows() const { return filtered_rows_; }
+
+    std::pair<InstanceDataMap, InstanceSet> take() {
+        flush_expr_rows();
+        return {std::move(data_), std::move(instances_)};
+    }
+
+private:
+    // Worker-local memo of dictionary codes, so repeated categorical values skip the
+    // shared dictionary's locks. Capped for high-cardinality columns.
+    static constexpr size_t kDictCacheLimit = 1u << 16;
+
+    template <typename T>
+    using KeyArray = std::conditional_t<KeyCols == 0, std::vector<T>, std::array<T, (KeyCols > 0 ? KeyCols : 1)>>;
+
+    size_t key_count() const {
+        if constexpr (KeyCols == 0) return inst_cols_.size();
+        else return KeyCols;
+    }
+
+    // Reads column `col` of the line as a number: NaN if it is not one, false if it is out
+    // of range.
+    bool column_number(int col, double& v) const {
+        NumParse res = opts_.units ? parse_scaled_number(parts_[col], v) : parse_number(parts_[col], v);
+        if (res == NumParse::Ok) return true;
+        v = std::numeric_limits<double>::quiet_NaN();
+        return res != NumParse::OutOfRange;
+    }
+
+    // Loads the --where columns of the line into batch row `row`; 'value' is `value`.
+    // Returns false if a column is out of range.
+    bool load_where_columns(size_t row, double value) {
+        const auto& cols = opts_.where->columns();
+        for (size_t c = 0; c < cols.size(); ++c) {
+            double& slot = ValueExpr::input(where_slots_, c, row);
+            if (cols[c] == ValueExpr::kValueColumn) {
+                slot = value;
+            } else if (!column_number(cols[c], slot)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A predicate holds if it is non-zero; NaN (a non-numeric operand) fails.
+    static bool passes(double v) { return v != 0 && v == v; }
+
+    // Queues the line's referenced columns for the --valexpr batch. The entry of its key is
+    // created (or kept) now and receives the derived value when the batch is evaluated; map
+    // nodes don't move, so the queued iterators stay valid. A line with an out-of-range
+    // column is dropped, like one with an out-of-range value.
+    void add_expr_row() {
+        if (expr_slots_.empty()) opts_.expr->init_slots(expr_slots_);
+        const auto& cols = opts_.expr->columns();
+        for (size_t c = 0; c < cols.size(); ++c) {
+            if (!column_number(cols[c], ValueExpr::input(expr_slots_, c, expr_rows_.size()))) return;
+        }
+        // The derived value itself is only known once the batch runs.
+        if (opts_.where && !load_where_columns(expr_rows_.size(), 0)) return;
+        auto it = data_.find(probe_);
+        if (it == data_.end()) {
+            InstanceKey key = InstanceKey::materialize(probe_, *mem_.keys);
+            it = data_.emplace(key, std::make_pair(RawValue(), ValueVariant())).first;
+            instances_.insert(key);
+        }
+        expr_rows_.push_back(it);
+        if (expr_rows_.size() == ValueExpr::kBatch) flush_expr_rows();
+    }
+
+    // Evaluates the queued --valexpr rows and stores each result with its shortest text as
+    // the raw value. Rows are stored in line order, so a repeated key keeps its last line.
+    // With --where the predicate runs over the batch too, and the last row of each key
+    // decides: passing stores the value, failing drops the key's entry.
+    void flush_expr_rows() {
+        if (expr_rows_.empty()) return;
+        const size_t n = expr_rows_.size();
+        const double* results = opts_.expr->run(expr_slots_, n);
+        const double* pass = nullptr;
+        if (opts_.where) {
+            const auto& cols = opts_.where->columns();
+            for (size_t c = 0; c < cols.size(); ++c) {
+                if (cols[c] == ValueExpr::kValueColumn) std::copy_n(results, n, &ValueExpr::input(where_slots_, c, 0));
+            }
+            pass = opts_.where->run(where_slots_, n);
+        }
+        char buf[32];
+        auto store = [&](size_t i) {
+            size_t len = std::to_chars(buf, buf + sizeof(buf), results[i]).ptr - buf;
+            expr_rows_[i]->second = {intern(*mem_.raw_values, std::string_view(buf, len)), results[i]};
+        };
+        if (!pass) {
+            for (size_t i = 0; i < n; ++i) store(i);
+        } else {
+            decided_.clear();
+            for (size_t i = n; i-- > 0;) {
+                if (!decided_.insert(&*expr_rows_[i]).second) continue;
+                if (passes(pass[i])) {
+                    store(i);
+                } else {
+                    data_.erase(expr_rows_[i]);
+                }
+            }
+        }
+        expr_rows_.clear();
+    }
+
+    // Applies the --normalize rules to the key fields; rewritten fields live in norm_buf_
+    // until the next line.
+    void normalize_key() {
+        size_t needed = 0;
+        for (size_t i = 0; i < key_count(); ++i) needed += key_fields_[i].size();
+        if (norm_buf_.size() < needed) norm_buf_.resize(needed);
+        char* out = norm_buf_.data();
+        for (size_t i = 0; i < key_count(); ++i) out += opts_.normalizer->apply(key_fields_[i], out);
+    }
+
+    KeyArray<int> inst_cols_;
+    int value_col_;
+    int max_col_;
+    WorkerMemory mem_;
+    const ParseOptions& opts_;
+    InstanceDataMap data_;
+    InstanceSet instances_;
+    std::pmr::unordered_map<std::string_view, std::pair<DictCode, std::string_view>> dict_cache_;
+    std::vector<std::string_view> parts_;
+    KeyArray<std::string_view> key_fields_;
+    std::vector<char> norm_buf_;
+    std::string sample_key_;
+    std::vector<double> expr_slots_;  // --valexpr batch, ValueExpr::kBatch values per slot
+    std::vector<InstanceDataMap::iterator> expr_rows_;
+    std::vector<double> where_slots_; // --where inputs, laid out like expr_slots_
+    std::unordered_set<const void*> decided_; // keys already settled by a later row of the batch
+    InstanceKey probe_;
+    uint64_t filtered_rows_ = 0;
+};
+
+template <typename Parser>
+struct ParserTag {
+    using type = Parser;
+};
+
+// Calls fn(ParserTag<LineParser<...>>{}) with the instantiation for the run's settings.
+// More than four key columns use the generic instantiation.
+template <Delimiter D, ValueMode M, typename Fn>
+auto with_key_count(size_t key_cols, Fn&& fn) {
+    switch (key_cols) {
+        case 1: return fn(ParserTag<LineParser<1, D, M>>{});
+        case 2: return fn(ParserTag<LineParser<2, D, M>>{});
+        case 3: return fn(ParserTag<LineParser<3, D, M>>{});
+        case 4: return fn(ParserTag<LineParser<4, D, M>>{});
+        default: return fn(ParserTag<LineParser<0, D, M>>{});
+    }
+}
+
+template <Delimiter D, typename Fn>
+auto with_value_mode(size_t key_cols, ValueMode mode, Fn&& fn) {
+    switch (mode) {
+        case ValueMode::String: return with_key_count<D, ValueMode::String>(key_cols, fn);
+        case ValueMode::Raw: return with_key_count<D, ValueMode::Raw>(key_cols, fn);
+        case ValueMode::Decimal: return with_key_count<D, ValueMode::Decimal>(key_cols, fn);
+        default: return with_key_count<D, ValueMode::Numeric>(key_cols, fn);
+    }
+}
+
+template <typename Fn>
+auto with_line_parser(size_t key_cols, Delimiter delim, ValueMode mode, Fn&& fn) {
+    switch (delim) {
+        case Delimiter::Comma: return with_value_mode<Delimiter::Comma>(key_cols, mode, fn);
+        case Delimiter::Tab: return with_value_mode<Delimiter::Tab>(key_cols, mode, fn);
+        default: return with_value_mode<Delimiter::Whitespace>(key_cols, mode, fn);
+    }
+}
+
+// Page-cache policy for one-shot inputs (--oneshot1/--oneshot2): read ahead of the parse
+// with WILLNEED and drop what has been parsed with DONTNEED, so scanning a huge file
+// doesn't evict other data from the page cache.
+class OneShotCache {
+public:
+    static constexpr uint64_t kReadAhead = 8u << 20;
+
+    OneShotCache(int fd, uint64_t start, bool enabled)
+        : fd_(fd), enabled_(enabled), dropped_(page_up(start)), advised_(start) {
+        if (enabled_) ::posix_fadvise(fd_, static_cast<off_t>(start), 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // Requests the bytes up to `pos + kReadAhead` (capped at `end`) ahead of time.
+    void read_ahead(uint64_t pos, uint64_t end) {
+        if (!enabled_) return;
+        uint64_t target = std::min(end, pos + kReadAhead);
+        if (target > advised_) {
+            ::posix_fadvise(fd_, static_cast<off_t>(advised_), static_cast<off_t>(target - advised_), POSIX_FADV_WILLNEED);
+            advised_ = target;
+        }
+    }
+
+    // Drops the whole pages below `pos`, which have been parsed.
+    void parsed_up_to(uint64_t pos) {
+        if (!enabled_) return;
+        uint64_t upto = pos & ~(kPage - 1);
+        if (upto > dropped_) {
+            ::posix_fadvise(fd_, static_cast<off_t>(dropped_), static_cast<off_t>(upto - dropped_), POSIX_FADV_DONTNEED);
+            dropped_ = upto;
+        }
+    }
+
+private:
+    static constexpr uint64_t kPage = 4096;
+    static uint64_t page_up(uint64_t pos) { return (pos + kPage - 1) & ~(kPage - 1); }
+
+    int fd_;
+    bool enabled_;
+    uint64_t dropped_;
+    uint64_t advised_;
+};
+
+// Reads the bytes [start, end) of a file in large blocks and calls
+// fn(line_begin, line_end, buffer_limit, line_offset) for each line, without its newline.
+// A final line without a newline is passed too. Returns false if the file can't be opened
+// or a read fails or ends before `end` (e.g. the file shrank); the lines up to there have
+// been passed, a pending partial line is not.
+template <typename Fn>
+bool for_each_line(const std::string& file_path, uint64_t start, uint64_t end, bool oneshot, Fn&& fn) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    OneShotCache cache(fd, start, oneshot);
+    std::vector<char> buf(4u << 20);
+    size_t used = 0;          // bytes in buf
+    uint64_t buf_pos = start; // file offset of buf[0]
+    bool complete = true;
+    while (buf_pos + used < end) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(buf.size() - used, end - (buf_pos + used)));
+        cache.read_ahead(buf_pos + used + want, end);
+        ssize_t n = ::pread(fd, buf.data() + used, want, static_cast<off_t>(buf_pos + used));
+        if (n <= 0) {
+            complete = false;
+            break;
+        }
+        used += static_cast<size_t>(n);
+        bool at_end = buf_pos + used >= end;
+
+        const char* line = buf.data();
+        const char* stop = buf.data() + used;
+        const char* limit = buf.data() + buf.size();
+        while (line < stop) {
+            const char* nl = static_cast<const char*>(std::memchr(line, '\n', stop - line));
+            if (!nl) {
+                if (!at_end) break;
+                nl = stop;
+            }
+            fn(line, nl, limit, buf_pos + static_cast<uint64_t>(line - buf.data()));
+            line = nl + 1;
+        }
+        // Keep the incomplete last line for the next read; grow if it fills the buffer.
+        size_t consumed = std::min(static_cast<size_t>(line - buf.data()), used);
+        std::memmove(buf.data(), buf.data() + consumed, used - consumed);
+        used -= consumed;
+        buf_pos += consumed;
+        cache.parsed_up_to(buf_pos);
+        if (used == buf.size()) buf.resize(buf.size() * 2);
+    }
+    ::close(fd);
+    return complete;
+}
+
+// The core worker function executed by each thread: parses the byte ranges of its chunk
+// (one range, except for a sparse --sample). A non-zero `index_stride` also records
+// sidecar index blocks for the chunk.
+template <typename Parser>
+ChunkResult process_chunk(
+    const std::string file_path,
+    const std::vector<std::pair<long long, long long>> ranges,
+    const std::vector<int> inst_cols,
+    int value_col,
+    WorkerMemory mem,
+    ParseOptions opts,
+    uint64_t index_stride
+) {
+    Parser parser(inst_cols, value_col, mem, opts);
+    std::vector<IndexBlock> blocks;
+    std::string key_text;
+    uint64_t line_no = 0;
+
+    auto on_line = [&](const char* begin, const char* end, const char* limit, uint64_t offset) {
+        if (index_stride) {
+            if (line_no++ % index_stride == 0) {
+                blocks.emplace_back();
+                blocks.back().offset = offset;
+            }
+            ++blocks.back().lines;
+        }
+        const InstanceKey* key = parser.parse_line(begin, end, limit, offset);
+        if (key && index_stride) {
+            IndexBlock& b = blocks.back();
+            key_text.clear();
+            key->append_display(key_text);
+            if (b.keys++ == 0 || key_text < b.key_min) b.key_min = key_text;
+            if (key_text > b.key_max) b.key_max = key_text;
+        }
+    };
+    bool complete = true;
+    for (const auto& range : ranges) complete &= for_each_line(file_path, range.first, range.second, opts.oneshot, on_line);
+    auto result = parser.take();
+    return {std::move(result.first), std::move(result.second), std::move(blocks), parser.filtered_rows(), complete};
+}
+
+// Resolves the file-positioned raw values (--lazy_raw) of the given keys. Positions are
+// read in offset order, either as views into `mapping` or, without a mapping, with
+// batched preads whose bytes are copied into `mr`. Values that can't be read back (a
+// failed or short read, or an offset past the end because the file changed after the
+// parse) stay unresolved and print as empty cells; their number is warned about and
+// returned.
+size_t rehydrate_raw_values(
+    const std::string& file_path, InstanceDataMap& data, const KeyList& keys,
+    const MappedFile* mapping, std::pmr::memory_resource& mr
+) {
+    std::vector<std::pair<RawValue, ValueVariant>*> pending;
+    pending.reserve(keys.size());
+    for (const auto& key : keys) {
+        auto& entry = data.at(key);
+        if (!entry.first.resolved()) pending.push_back(&entry);
+    }
+    if (pending.empty()) return 0;
+    std::sort(pending.begin(), pending.end(), [](const auto* a, const auto* b) {
+        return a->first.file_offset() < b->first.file_offset();
+    });
+
+    size_t resolved = 0;
+    auto resolve = [&resolved](std::pair<RawValue, ValueVariant>* entry, std::string_view text) {
+        entry->first = text;
+        if (std::holds_alternative<std::string_view>(entry->second)) entry->second = text;
+        ++resolved;
+    };
+    auto report_unread = [&] {
+        size_t unread = pending.size() - resolved;
+        if (unread) {
+            std::cerr << "Warning: " << unread << " raw values of " << file_path << " could not be read back "
+                      << "(read error, or the file changed after parsing); they are written as empty cells." << std::endl;
+        }
+        return unread;
+    };
+
+    if (mapping) {
+        for (auto* entry : pending) {
+            uint64_t off = entry->first.file_offset(), len = entry->first.file_length();
+            if (off + len <= mapping->size()) resolve(entry, std::string_view(mapping->data() + off, len));
+        }
+        return report_unread();
+    }
+
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "❌ Error: Cannot reopen file '" << file_path << "' to read raw values." << std::endl;
+        return report_unread();
+    }
+    constexpr uint64_t kBatchBytes = 1u << 20;
+    std::vector<char> buf;
+    for (size_t i = 0; i < pending.size();) {
+        // Gather the run of values that fits in one read.
+        uint64_t batch_start = pending[i]->first.file_offset();
+        uint64_t batch_end = batch_start + pending[i]->first.file_length();
+        size_t j = i + 1;
+        while (j < pending.size()) {
+            uint64_t end = pending[j]->first.file_offset() + pending[j]->first.file_length();
+            if (end - batch_start > kBatchBytes) break;
+            batch_end = std::max(batch_end, end);
+            ++j;
+        }
+        buf.resize(batch_end - batch_start);
+        ssize_t got = ::pread(fd, buf.data(), buf.size(), static_cast<off_t>(batch_start));
+        for (; i < j; ++i) {
+            uint64_t off = pending[i]->first.file_offset() - batch_start, len = pending[i]->first.file_length();
+            if (got >= 0 && off + len <= static_cast<uint64_t>(got))
+                resolve(pending[i], intern(mr, std::string_view(buf.data() + off, len)));
+        }
+    }
+    ::close(fd);
+    return report_unread();
+}
+
+// Orchestrates the parallel parsing of a file. Each worker parses into its own
+// arena from `region`; the merged maps get one more arena.
+std::pair<InstanceDataMap, InstanceSet> parallel_parse_file(
+    const std::string& file_path,
+    const std::vector<int>& inst_cols,
+    int value_col,
+    Region& region,
+    const ParseOptions& opts
+) {
+    unsigned int num_workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "\nParsing " << file_path << " with " << num_workers << " workers"
+              << (opts.oneshot ? " (one-shot: parsed ranges leave the page cache)" : "") << "..." << std::endl;
+
+    LineIndex index;
+    uint64_t build_stride = 0;
+    std::vector<std::vector<std::pair<long long, long long>>> chunks;
+    if (opts.byte_ranges) {
+        // A sparse --sample reads only the ranges of its sampled blocks, dealt out to the
+        // workers in file order with about equal bytes each.
+        long long total = 0, filled = 0;
+        for (const auto& r : *opts.byte_ranges) total += r.second - r.first;
+        long long share = total / num_workers + 1;
+        chunks.emplace_back();
+        for (const auto& r : *opts.byte_ranges) {
+            if (filled >= share) {
+                chunks.emplace_back();
+                filled = 0;
+            }
+            auto& mine = chunks.back();
+            if (!mine.empty() && mine.back().second == r.first) {
+                mine.back().second = r.second;
+            } else {
+                mine.push_back(r);
+            }
+            filled += r.second - r.first;
+        }
+    } else {
+        // With --index, a valid sidecar gives line-balanced chunks without touching the file;
+        // otherwise the workers build one while parsing.
+        bool have_index = opts.use_index && load_line_index(file_path, index);
+        if (have_index) {
+            std::cout << "Using line index " << index_path_for(file_path) << " (" << index.blocks.size() << " blocks)" << std::endl;
+        } else if (opts.use_index && stat_file(file_path, index.file_size, index.file_mtime_ns)) {
+            build_stride = std::max<uint64_t>(1, opts.index_stride);
+            index.stride = build_stride;
+            index.inst_cols = inst_cols;
+        }
+
+        auto boundaries = have_index ? chunk_boundaries_from_index(index, num_workers)
+                                     : find_chunk_boundaries(file_path, num_workers);
+        if (boundaries.empty()) {
+            std::cout << "Warning: File " << file_path << " is empty or could not be read." << std::endl;
+            return {InstanceDataMap(&region.main()), InstanceSet(&region.main())};
+        }
+        for (const auto& chunk : boundaries) chunks.push_back({chunk});
+    }
+
+    std::vector<std::future<ChunkResult>> futures;
+    with_line_parser(inst_cols.size(), opts.delim, opts.mode, [&](auto tag) {
+        using Parser = typename decltype(tag)::type;
+        for (const auto& ranges : chunks) {
+            futures.push_back(std::async(std::launch::async, process_chunk<Parser>, file_path, ranges, inst_cols, value_col, region.new_worker(), opts, build_stride));
+        }
+        return 0;
+    });
+
+    TrackedResource& merged = region.tracked(region.new_arena(), MemCategory::MergedTables);
+    InstanceDataMap final_data(&merged);
+    InstanceSet final_instances_set(&merged);
+    uint64_t filtered_rows = 0;
+    bool complete = true;
+    for (auto& fut : futures) {
+        auto result = fut.get();
+        filtered_rows += result.filtered_rows;
+        complete &= result.complete;
+        final_data.insert(result.data.begin(), result.data.end());
+        final_instances_set.insert(result.instances.begin(), result.instances.end());
+        for (auto& b : result.index_blocks) index.blocks.push_back(std::move(b));
+    }
+
+    if (opts.filter && !opts.backfill) {
+        std::cout << "Semi-join filter: " << filtered_rows << " rows of " << file_path
+                  << " have no match and skipped value parsing." << std::endl;
+    }
+
+    if (!complete) {
+        std::cerr << "Warning: Could not read all of " << file_path << " (read error or the file shrank); "
+                  << "its instances and counts are incomplete." << std::endl;
+    }
+
+    if (build_stride && complete) {
+        if (write_line_index(file_path, index)) {
+            std::cout << "Wrote line index " << index_path_for(file_path) << " (" << index.blocks.size() << " blocks)" << std::endl;
+        } else {
+            std::cerr << "Warning: Could not write line index " << index_path_for(file_path) << std::endl;
+        }
+    }
+
+    return {std::move(final_data), std::move(final_instances_set)};
+}
+
+// Reads back the values of `keys`, which failed the --where predicate of this file but
+// passed in the other one, into `data`. A Bloom filter of the keys makes the pass skip the
+// value conversion of every other row, as in the semi-join; the last line of a key wins.
+void backfill_values(
+    const std::string& file_path, const std::vector<int>& inst_cols, int value_col,
+    const KeyList& keys, InstanceDataMap& data, Region& region, ParseOptions opts
+) {
+    if (keys.empty()) return;
+    BloomFilter filter(keys.size());
+    for (const auto& key : keys) filter.add(key.hash());
+    opts.filter = &filter;
+    opts.where = nullptr;
+    opts.use_index = false;
+    opts.backfill = true;
+    auto values = parallel_parse_file(file_path, inst_cols, value_col, region, opts).first;
+    for (const auto& key : keys) {
+        auto it = values.find(key);
+        if (it != values.end()) data.emplace(key, it->second);
+    }
+}
+
+// Settings of the --follow1/--follow2 tail mode.
+struct FollowOptions {
+    std::string trailer;      // a line starting with this ends the report ("" = none)
+    double idle_timeout = 300; // seconds without new data before giving up (0 = wait forever)
+};
+
+enum class WriterCheck { None, Some, Unknown };
+
+// Whether a local process has the file of `fd` open for writing, found by matching the
+// links in /proc/<pid>/fd and reading the access mode from /proc/<pid>/fdinfo. Processes
+// whose fds can't be read are passed over. Unknown without /proc, or when the file is on
+// a network filesystem, whose writers may be on other hosts.
+WriterCheck file_writers(int fd) {
+    struct stat target;
+    struct statfs fs;
+    if (::fstat(fd, &target) != 0 || ::fstatfs(fd, &fs) != 0) return WriterCheck::Unknown;
+    switch (static_cast<unsigned long>(fs.f_type)) {
+        case 0x6969:      // NFS
+        case 0x517B:      // SMB
+        case 0xFF534D42:  // CIFS
+        case 0xFE534D42:  // SMB2
+            return WriterCheck::Unknown;
+    }
+    DIR* proc = ::opendir("/proc");
+    if (!proc) return WriterCheck::Unknown;
+    WriterCheck result = WriterCheck::None;
+    while (result == WriterCheck::None) {
+        dirent* p = ::readdir(proc);
+        if (!p) break;
+        if (p->d_name[0] < '0' || p->d_name[0] > '9') continue;
+        std::string pid_dir = std::string("/proc/") + p->d_name;
+        DIR* fds = ::opendir((pid_dir + "/fd").c_str());
+        if (!fds) continue;
+        while (dirent* f = ::readdir(fds)) {
+            if (f->d_name[0] < '0' || f->d_name[0] > '9') continue;
+            struct stat st;
+            if (::stat((pid_dir + "/fd/" + f->d_name).c_str(), &st) != 0 ||
+                st.st_dev != target.st_dev || st.st_ino != target.st_ino) continue;
+            std::ifstream info(pid_dir + "/fdinfo/" + f->d_name);
+            std::string field;
+            unsigned long flags = 0;
+            while (info >> field && field != "flags:") {}
+            if (info >> std::oct >> flags && (flags & O_ACCMODE) != O_RDONLY) {
+                result = WriterCheck::Some;
+                break;
+            }
+        }
+        ::closedir(fds);
+    }
+    ::closedir(proc);
+    return result;
+}
+
+// Parses a report while its writer is still appending to it. Complete lines are parsed as
+// they land, found through inotify events with periodic size polling as a fallback (e.g. on
+// NFS). The parse is final once no process has the file open for writing any more (checked
+// after the first read, after a close, and periodically without inotify), a trailer line
+// appears, or the idle timeout expires. Where writers can't be checked, a close followed by
+// a quiet period without growth ends the parse.
+template <typename Parser>
+std::pair<InstanceDataMap, InstanceSet> follow_parse_file(
+    const std::string& file_path,
+    const std::vector<int>& inst_cols,
+    int value_col,
+    Region& region,
+    const ParseOptions& opts,
+    const FollowOptions& follow
+) {
+    using clock = std::chrono::steady_clock;
+    constexpr int kPollMs = 500;
+    constexpr double kQuietSeconds = 1;        // no growth after a close before it counts
+    constexpr double kCheckIntervalSeconds = 5; // writer checks without inotify
+    std::cout << "\nFollowing " << file_path << " until its writer finishes..." << std::endl;
+
+    auto idle_expired = [&](clock::time_point since) {
+        return follow.idle_timeout > 0 && std::chrono::duration<double>(clock::now() - since).count() > follow.idle_timeout;
+    };
+
+    // The writer may not have created the file yet.
+    auto t_wait = clock::now();
+    int fd;
+    while ((fd = ::open(file_path.c_str(), O_RDONLY)) < 0) {
+        if (idle_expired(t_wait)) {
+            std::cout << "Warning: File " << file_path << " never appeared." << std::endl;
+            return {InstanceDataMap(&region.main()), InstanceSet(&region.main())};
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kPollMs));
+    }
+    int inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 && ::inotify_add_watch(inotify_fd, file_path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        ::close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    // There is no merge: the worker's maps are the file's final maps.
+    Parser parser(inst_cols, value_col, region.new_worker(MemCategory::MergedTables), opts);
+    OneShotCache cache(fd, 0, opts.oneshot);
+    std::vector<char> buf(4u << 20);
+    size_t used = 0;        // bytes in buf
+    uint64_t buf_pos = 0;   // file offset of buf[0]
+    uint64_t lines = 0;
+    bool writer_closed = false, trailer_seen = false, checked = false, close_seen = false;
+    auto t_last_data = clock::now(), t_last_report = clock::now(), t_close = clock::now(), t_check = clock::now();
+    auto seconds_since = [](clock::time_point t) { return std::chrono::duration<double>(clock::now() - t).count(); };
+
+    auto parse_line = [&](const char* begin, const char* end) {
+        ++lines;
+        if (!follow.trailer.empty() && static_cast<size_t>(end - begin) >= follow.trailer.size() &&
+            std::memcmp(begin, follow.trailer.data(), follow.trailer.size()) == 0) {
+            trailer_seen = true;
+            return;
+        }
+        parser.parse_line(begin, end, buf.data() + buf.size(), buf_pos + static_cast<uint64_t>(begin - buf.data()));
+    };
+
+    while (!trailer_seen) {
+        // Drain everything appended so far, parsing complete lines.
+        ssize_t n;
+        while (!trailer_seen && (n = ::read(fd, buf.data() + used, buf.size() - used)) > 0) {
+            t_last_data = clock::now();
+            size_t scanned = used;
+            used += static_cast<size_t>(n);
+            const char* line = buf.data();
+            const char* end = buf.data() + used;
+            const char* nl;
+            while (!trailer_seen && (nl = static_cast<const char*>(std::memchr(buf.data() + scanned, '\n', end - (buf.data() + scanned))))) {
+                parse_line(line, nl);
+                line = nl + 1;
+                scanned = static_cast<size_t>(line - buf.data());
+            }
+            // Keep the incomplete last line for the next read; grow if it fills the buffer.
+            size_t consumed = static_cast<size_t>(line - buf.data());
+            std::memmove(buf.data(), line, used - consumed);
+            used -= consumed;
+            buf_pos += consumed;
+            cache.parsed_up_to(buf_pos);
+            if (used == buf.size()) buf.resize(buf.size() * 2);
+        }
+        if (trailer_seen || idle_expired(t_last_data)) break;
+
+        // A close is only a hint: the writer may reopen the file and append again.
+        if (close_seen && t_last_data > t_close) close_seen = false;
+        bool quiet = close_seen && seconds_since(t_close) >= kQuietSeconds;
+        if (!checked || quiet || (inotify_fd < 0 && seconds_since(t_check) >= kCheckIntervalSeconds)) {
+            checked = true;
+            t_check = clock::now();
+            WriterCheck writers = file_writers(fd);
+            if (writers == WriterCheck::None || (writers == WriterCheck::Unknown && quiet)) {
+                writer_closed = true;
+                break;
+            }
+            if (writers == WriterCheck::Some) close_seen = false;
+        }
+
+        if (seconds_since(t_last_report) >= 10) {
+            std::cout << "  ... " << file_path << ": " << lines << " lines, " << parser.size() << " instances so far" << std::endl;
+            t_last_report = clock::now();
+        }
+
+        // Sleep until the writer appends or closes; the timeout doubles as size polling.
+        if (inotify_fd >= 0) {
+            struct pollfd pfd = {inotify_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, kPollMs) > 0) {
+                alignas(struct inotify_event) char events[4096];
+                ssize_t len;
+                while ((len = ::read(inotify_fd, events, sizeof(events))) > 0) {
+                    for (char* e = events; e < events + len;) {
+                        auto* ev = reinterpret_cast<struct inotify_event*>(e);
+                        if (ev->mask & IN_CLOSE_WRITE) {
+                            close_seen = true;
+                            t_close = clock::now();
+                        }
+                        e += sizeof(struct inotify_event) + ev->len;
+                    }
+                }
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollMs));
+        }
+    }
+    // A final line without a newline is complete once the writer is done. On an idle
+    // timeout the writer may be mid-line, so the partial line is dropped.
+    if (!trailer_seen && used > 0) {
+        if (writer_closed) {
+            parse_line(buf.data(), buf.data() + used);
+        } else {
+            std::cerr << "Warning: Dropped an unterminated last line of " << file_path << " (" << used
+                      << " bytes) after the idle timeout; its writer may not have finished it." << std::endl;
+        }
+    }
+
+    if (inotify_fd >= 0) ::close(inotify_fd);
+    ::close(fd);
+    std::cout << "Finished following " << file_path << " (" << lines << " lines, "
+              << (trailer_seen ? "trailer line seen" : writer_closed ? "no writer has it open" : "idle timeout")
+              << ")." << std::endl;
+
+    return parser.take();
+}
+
+// Runs fn(lo, hi) on `workers` slices of [0, n) in parallel.
+template <typename Fn>
+void parallel_slices(size_t n, unsigned workers, Fn&& fn) {
+    size_t step = std::max<size_t>(1, (n + workers - 1) / std::max(1u, workers));
+    std::vector<std::future<void>> futures;
+    for (size_t lo = 0; lo < n; lo += step) {
+        futures.push_back(std::async(std::launch::async, [&fn, lo, hi = std::min(n, lo + step)] { fn(lo, hi); }));
+    }
+    for (auto& fut : futures) fut.get();
+}
+
+// Per-hierarchy value tolerances (--tolerances <file>). Each line of the spec holds a key
+// pattern and its limits:
+//   <pattern> [abs=<limit>] [rel=<limit>[%]] [sig=<digits>] [ulp=<n>]
+// A pattern is a key prefix ('u_core/u_io/' or 'u_core/u_io*'), a substring when it starts
+// with '*' ('*/u_analog/*'), or '*' alone for the default. A key takes the rule of its
+// longest matching pattern (the later line on ties). A pair of numeric values passes if
+// their difference is within any of the limits. 'sig' asks for agreement to that many
+// significant digits; 'ulp' allows n units in the last place, of the printed precision
+// for exact decimals and of the double format otherwise. All patterns are compiled into one
+// Aho-Corasick automaton, so resolving a key is one table step per byte of the key
+// however many rules there are.
+class ToleranceSpec {
+public:
+    struct Rule {
+        std::string text;      // pattern as written, for the output
+        std::string pattern;   // bytes to match
+        bool anchored = true;  // must match at the start of the key
+        double abs_limit = 0;
+        double rel_limit = 0;  // fraction of the file2 value
+        int sig_digits = 0;    // 0 = no significant-digit limit
+        long ulps = -1;        // -1 = no ULP limit
+    };
+
+    // Reads and compiles a spec file. On failure returns false with a message in `error`.
+    bool load(const std::string& path, std::string& error) {
+        std::ifstream in(path);
+        if (!in) {
+            error = "Cannot open tolerance spec '" + path + "'";
+            return false;
+        }
+        std::string line;
+        for (int line_no = 1; std::getline(in, line); ++line_no) {
+            std::istringstream fields(line);
+            std::string word;
+            if (!(fields >> word) || word[0] == '#') continue;
+            Rule rule;
+            rule.text = word;
+            if (word.back() == '*') word.pop_back();
+            if (!word.empty() && word[0] == '*') {
+                rule.anchored = false;
+                word.erase(0, 1);
+            }
+            rule.pattern = word;
+            try {
+                while (fields >> word) {
+                    if (word.rfind("abs=", 0) == 0) {
+                        rule.abs_limit = std::stod(word.substr(4));
+                    } else if (word.rfind("rel=", 0) == 0) {
+                        bool percent = word.back() == '%';
+                        rule.rel_limit = std::stod(word.substr(4, word.size() - 4 - percent)) / (percent ? 100.0 : 1.0);
+                    } else if (word.rfind("sig=", 0) == 0 && (rule.sig_digits = std::stoi(word.substr(4))) > 0) {
+                    } else if (word.rfind("ulp=", 0) == 0 && (rule.ulps = std::stol(word.substr(4))) >= 0) {
+                    } else {
+                        throw std::invalid_argument(word);
+                    }
+                }
+            } catch (const std::exception&) {
+                error = path + ":" + std::to_string(line_no) + ": expected 'abs=<limit>', 'rel=<limit>[%]', 'sig=<digits>' or 'ulp=<n>' after the pattern";
+                return false;
+            }
+            rules_.push_back(std::move(rule));
+        }
+        compile();
+        return true;
+    }
+
+    // Index of the rule for `key`, or -1 if no pattern matches.
+    int resolve(std::string_view key) const {
+        int best = default_rule_;
+        uint32_t node = 0;
+        for (size_t i = 0; i < key.size(); ++i) {
+            node = next_[node * classes_ + byte_class_[static_cast<unsigned char>(key[i])]];
+            if (floating_best_[node] >= 0) best = better(best, floating_best_[node]);
+            if (anchored_rule_[node] >= 0 && depth_[node] == i + 1) best = better(best, anchored_rule_[node]);
+        }
+        return best;
+    }
+
+    const Rule& rule(int i) const { return rules_[i]; }
+    size_t size() const { return rules_.size(); }
+
+    // True if the difference of a numeric pair is within any limit of rule `i`.
+    bool within(int i, double val1, double val2) const {
+        const Rule& r = rules_[i];
+        double diff = std::fabs(val1 - val2);
+        return diff <= r.abs_limit || diff <= r.rel_limit * std::fabs(val2) ||
+               (r.sig_digits && within_sig_digits(val1, val2, r.sig_digits)) ||
+               (r.ulps >= 0 && within_ulps(val1, val2, static_cast<uint64_t>(r.ulps)));
+    }
+
+    // The same for two exact decimals: the significant-digit and ULP limits are checked on
+    // the scaled integers, the absolute and relative limits in doubles.
+    bool within(int i, const Decimal& val1, const Decimal& val2, const AlignedDecimals& aligned) const {
+        const Rule& r = rules_[i];
+        if (r.sig_digits && within_sig_digits(aligned, r.sig_digits)) return true;
+        if (r.ulps >= 0 && within_ulps(val1, val2, aligned, static_cast<uint64_t>(r.ulps))) return true;
+        double v1 = decimal_to_double(val1), v2 = decimal_to_double(val2), diff = std::fabs(v1 - v2);
+        return diff <= r.abs_limit || diff <= r.rel_limit * std::fabs(v2);
+    }
+
+private:
+    // Longer patterns are more specific; on equal length the later rule wins.
+    int better(int a, int b) const {
+        if (a < 0) return b;
+        size_t la = rules_[a].pattern.size(), lb = rules_[b].pattern.size();
+        return lb > la || (lb == la && b > a) ? b : a;
+    }
+
+    void compile() {
+        // Bytes that occur in no pattern share class 0, which always leads back to the root.
+        byte_class_.fill(0);
+        classes_ = 1;
+        for (const auto& r : rules_) {
+            for (unsigned char c : r.pattern) {
+                if (!byte_class_[c]) byte_class_[c] = static_cast<uint8_t>(classes_++);
+            }
+        }
+        const uint32_t none = UINT32_MAX;
+        next_.assign(classes_, none);
+        depth_.assign(1, 0);
+        anchored_rule_.assign(1, -1);
+        floating_best_.assign(1, -1);
+        std::vector<int> floating_rule(1, -1);
+        for (size_t id = 0; id < rules_.size(); ++id) {
+            const Rule& r = rules_[id];
+            if (r.pattern.empty()) {
+                default_rule_ = better(default_rule_, static_cast<int>(id));
+                continue;
+            }
+            uint32_t node = 0;
+            for (unsigned char c : r.pattern) {
+                uint32_t& slot = next_[node * classes_ + byte_class_[c]];
+                if (slot == none) {
+                    slot = static_cast<uint32_t>(depth_.size());
+                    depth_.push_back(depth_[node] + 1);
+                    anchored_rule_.push_back(-1);
+                    floating_best_.push_back(-1);
+                    floating_rule.push_back(-1);
+                    next_.resize(next_.size() + classes_, none);
+                }
+                node = next_[node * classes_ + byte_class_[c]];
+            }
+            int& target = r.anchored ? anchored_rule_[node] : floating_rule[node];
+            target = target < 0 ? static_cast<int>(id) : better(target, static_cast<int>(id));
+        }
+
+        // Breadth-first: fill the missing transitions from the failure links, and let each
+        // node inherit the best floating rule of its longest proper suffix.
+        std::vector<uint32_t> fail(depth_.size(), 0), queue;
+        for (size_t c = 0; c < classes_; ++c) {
+            uint32_t& slot = next_[c];
+            if (slot == none) {
+                slot = 0;
+            } else {
+                queue.push_back(slot);
+            }
+        }
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint32_t node = queue[head];
+            int inherited = floating_best_[fail[node]];
+            floating_best_[node] = floating_rule[node] < 0 ? inherited
+                                 : inherited < 0 ? floating_rule[node] : better(inherited, floating_rule[node]);
+            for (size_t c = 0; c < classes_; ++c) {
+                uint32_t& slot = next_[node * classes_ + c];
+                uint32_t via_fail = next_[fail[node] * classes_ + c];
+                if (slot == none) {
+                    slot = via_fail;
+                } else {
+                    fail[slot] = via_fail;
+                    queue.push_back(slot);
+                }
+            }
+        }
+    }
+
+    std::vector<Rule> rules_;
+    int default_rule_ = -1;
+    std::array<uint8_t, 256> byte_class_{};
+    size_t classes_ = 1;
+    std::vector<uint32_t> next_;        // DFA transitions, classes_ per node
+    std::vector<uint32_t> depth_;       // length of each node's string
+    std::vector<int> anchored_rule_;    // prefix rule spelled exactly by the node, or -1
+    std::vector<int> floating_best_;    // best substring rule ending at the node, or -1
+};
+
+// How a matched pair of values fares against its tolerance rule.
+struct ToleranceVerdict {
+    int rule = -1;      // rule index, or -1 when no pattern matches
+    int8_t within = -1; // 1 within, 0 outside, -1 not applicable (no rule or non-numeric)
+};
+
+// Resolves the tolerance rule of every matched key and checks its values against it, in
+// parallel. Two exact decimals are checked on their aligned integers, other numbers as
+// doubles; non-numeric pairs stay not applicable.
+std::vector<ToleranceVerdict> check_tolerances(
+    const ToleranceSpec& spec, const InstanceDataMap& data1, const InstanceDataMap& data2,
+    const KeyList& matched, unsigned workers
+) {
+    std::vector<ToleranceVerdict> verdicts(matched.size());
+    parallel_slices(matched.size(), workers, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            ToleranceVerdict& v = verdicts[i];
+            v.rule = spec.resolve(matched[i].display());
+            if (v.rule < 0) continue;
+            const ValueVariant& value1 = data1.at(matched[i]).second;
+            const ValueVariant& value2 = data2.at(matched[i]).second;
+            const Decimal* dec1 = std::get_if<Decimal>(&value1);
+            const Decimal* dec2 = std::get_if<Decimal>(&value2);
+            AlignedDecimals aligned;
+            double val1, val2;
+            if (dec1 && dec2 && aligned.align(*dec1, *dec2)) {
+                v.within = spec.within(v.rule, *dec1, *dec2, aligned);
+            } else if (numeric_value(value1, val1) && numeric_value(value2, val2)) {
+                v.within = spec.within(v.rule, val1, val2);
+            }
+        }
+    });
+    return verdicts;
+}
+
+// Writes the comparison CSV file. With a tolerance spec, each row also names its rule
+// and whether the values are within it, from the `verdicts` of check_tolerances().
+void write_comparison_csv(
+    const std::string& file1_name, const std::string& file2_name,
+    const InstanceDataMap& data1, const InstanceDataMap& data2,
+    const KeyList& matched,
+    const ToleranceSpec* spec = nullptr, const std::vector<ToleranceVerdict>* verdicts = nullptr
+) {
+    std::cout << "Writing comparison.csv..." << std::endl;
+    std::ofstream csvfile("comparison.csv");
+    csvfile << "Key,Value_" << file1_name << ",Value_" << file2_name << ",Difference,Deviation_Match";
+    if (spec) csvfile << ",Tolerance_Rule,Within_Tolerance";
+    csvfile << "\n";
+
+    for (size_t i = 0; i < matched.size(); ++i) {
+        const auto& key = matched[i];
+        const auto& pair1 = data1.at(key);
+        const auto& pair2 = data2.at(key);
+
+        csvfile << key << "," << pair1.first.text() << "," << pair2.first.text() << ",";
+
+        // Two exact decimals have an exact difference; other numbers compare as doubles.
+        const Decimal* dec1 = std::get_if<Decimal>(&pair1.second);
+        const Decimal* dec2 = std::get_if<Decimal>(&pair2.second);
+        AlignedDecimals aligned;
+        double val1, val2;
+        if (dec1 && dec2 && aligned.align(*dec1, *dec2)) {
+            int128 diff = aligned.a - aligned.b;
+            csvfile << format_decimal(diff, aligned.exponent) << ",";
+            if (aligned.b != 0) {
+                csvfile << static_cast<double>(diff) / static_cast<double>(aligned.b) * 100 << "%";
+            } else {
+                csvfile << "inf";
+            }
+        } else if (numeric_value(pair1.second, val1) && numeric_value(pair2.second, val2)) {
+            double diff = val1 - val2;
+            csvfile << diff << ",";
+            if (val2 != 0) {
+                csvfile << (diff / val2) * 100 << "%";
+            } else {
+                csvfile << "inf";
+            }
+        } else if (std::holds_alternative<DictCode>(pair1.second) && std::holds_alternative<DictCode>(pair2.second)) {
+            bool same = std::get<DictCode>(pair1.second).code == std::get<DictCode>(pair2.second).code;
+            csvfile << "N/A," << (same ? "YES" : "NO");
+        } else {
+            csvfile << "N/A," << (pair1.first.text() == pair2.first.text() ? "YES" : "NO");
+        }
+        if (spec) {
+            const ToleranceVerdict& v = (*verdicts)[i];
+            csvfile << "," << (v.rule >= 0 ? spec->rule(v.rule).text : std::string())
+                    << "," << (v.within < 0 ? "N/A" : v.within ? "YES" : "NO");
+        }
+        csvfile << "\n";
+    }
+}
+
+// Layout of the key lists in missing_instances.txt (--missing_format).
+enum class MissingFormat {
+    Full,       // one full key per line
+    Grouped,    // front-coded under '/'-separated hierarchy prefixes, with counts
+    Collapsed,  // grouped, and a subtree without any matched instance is one entry
+};
+
+// Writes sorted keys front-coded by hierarchy level: each '/'-terminated prefix is printed
+// once, indented by its depth and followed by the number of keys below it, and each key
+// prints only its last level. Keys sharing a prefix are adjacent in sorted order, so a
+// group's size is a binary search. With `matched` (sorted), a prefix that has no matched
+// key below it is written as a single collapsed entry instead of its keys.
+void write_grouped_keys(std::ostream& out, const KeyList& keys, const KeyList* matched) {
+    auto starts_with = [](std::string_view s, std::string_view prefix) {
+        return s.size() >= prefix.size() && std::memcmp(s.data(), prefix.data(), prefix.size()) == 0;
+    };
+    auto indent = [&](size_t depth) { out << std::string(2 * depth, ' '); };
+    std::vector<std::string_view> open;  // prefixes of the current key's open groups
+    size_t i = 0;
+    while (i < keys.size()) {
+        std::string_view key = keys[i].display();
+        while (!open.empty() && !starts_with(key, open.back())) open.pop_back();
+        size_t pos = open.empty() ? 0 : open.back().size();
+        bool collapsed = false;
+        for (size_t slash; (slash = key.find('/', pos)) != std::string_view::npos; pos = slash + 1) {
+            std::string_view prefix = key.substr(0, slash + 1);
+            size_t end = std::partition_point(keys.begin() + i, keys.end(), [&](const InstanceKey& k) {
+                return starts_with(k.display(), prefix);
+            }) - keys.begin();
+            indent(open.size());
+            if (matched) {
+                auto it = std::lower_bound(matched->begin(), matched->end(), prefix, [](const InstanceKey& k, std::string_view p) {
+                    return k.display() < p;
+                });
+                if (it == matched->end() || !starts_with(it->display(), prefix)) {
+                    out << prefix.substr(pos) << "* (" << end - i << ", no instance of the subtree matched)\n";
+                    i = end;
+                    collapsed = true;
+                    break;
+                }
+            }
+            out << prefix.substr(pos) << " (" << end - i << ")\n";
+            open.push_back(prefix);
+        }
+        if (collapsed) continue;
+        indent(open.size());
+        out << key.substr(pos) << "\n";
+        ++i;
+    }
+}
+
+// Writes the missing instances file. `matched` is only used by the collapsed format.
+void write_missing_file(
+    const std::string& file1_name, const std::string& file2_name,
+    const KeyList& miss2, const KeyList& miss1,
+    MissingFormat format = MissingFormat::Full, const KeyList* matched = nullptr
+) {
+    std::ofstream out("missing_instances.txt");
+    auto write_keys = [&](const KeyList& keys) {
+        if (format == MissingFormat::Full) {
+            for (const auto& inst : keys) out << inst << "\n";
+        } else {
+            write_grouped_keys(out, keys, format == MissingFormat::Collapsed ? matched : nullptr);
+        }
+    };
+    out << "============================================================\n";
+    out << "Instances missing from " << file2_name << ":\n";
+    out << "============================================================\n";
+    write_keys(miss2);
+
+    out << "\n============================================================\n";
+    out << "Instances missing from " << file1_name << ":\n";
+    out << "============================================================\n";
+    write_keys(miss1);
+}
+
+// Prints the per-structure memory of each phase: the peak within the phase and the
+// bytes still live at the end of the run, plus the allocation counts.
+void print_memory_breakdown(const std::vector<MemPhase>& phases) {
+    if (phases.empty()) return;
+    const MemPhase& last = phases.back();
+    auto mib = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+    std::cout << "\nMemory by structure (MiB, peak per phase):\n";
+    std::cout << "  " << std::left << std::setw(18) << "structure" << std::right;
+    for (const auto& phase : phases) std::cout << std::setw(10) << phase.name;
+    std::cout << std::setw(10) << "live" << std::setw(14) << "allocations" << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t c = 0; c < kMemCategories; ++c) {
+        std::cout << "  " << std::left << std::setw(18) << kMemCategoryNames[c] << std::right;
+        for (const auto& phase : phases) std::cout << std::setw(10) << mib(phase.peak[c]);
+        std::cout << std::setw(10) << mib(last.live[c]) << std::setw(14) << last.allocations[c] << "\n";
+    }
+    std::cout << "  " << std::left << std::setw(18) << "arena reserved" << std::right;
+    for (const auto& phase : phases) std::cout << std::setw(10) << mib(phase.arena_reserved);
+    std::cout << "\n  " << std::left << std::setw(18) << "phase time (s)" << std::right << std::setprecision(3);
+    for (const auto& phase : phases) std::cout << std::setw(10) << phase.seconds;
+    std::cout << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+// Escapes a string for a JSON string literal.
+std::string json_escape(std::string_view s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// The results of a comparison run, for --json_report.
+struct RunReport {
+    std::string file1, file2;
+    size_t instances1 = 0, instances2 = 0;
+    size_t matched = 0, missing_in_file2 = 0, missing_in_file1 = 0;
+    size_t dict_values = 0;
+    size_t location_matches = 0;
+    size_t outside_tolerance = 0;
+    size_t suggestions = 0;
+    size_t bucket_bytes = 0;
+    double elapsed_seconds = 0;
+    double teardown_seconds = 0;  // from the summary to exit (with --fast_exit, to _Exit)
+    std::vector<MemPhase> memory;
+};
+
+// Writes the run summary as JSON, including the per-phase memory of each structure.
+bool write_json_report(const std::string& path, const RunReport& report) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\n";
+    out << "  \"file1\": \"" << json_escape(report.file1) << "\",\n";
+    out << "  \"file2\": \"" << json_escape(report.file2) << "\",\n";
+    out << "  \"instances_file1\": " << report.instances1 << ",\n";
+    out << "  \"instances_file2\": " << report.instances2 << ",\n";
+    out << "  \"matched\": " << report.matched << ",\n";
+    out << "  \"missing_from_file2\": " << report.missing_in_file2 << ",\n";
+    out << "  \"missing_from_file1\": " << report.missing_in_file1 << ",\n";
+    out << "  \"dictionary_values\": " << report.dict_values << ",\n";
+    out << "  \"location_matches\": " << report.location_matches << ",\n";
+    out << "  \"outside_tolerance\": " << report.outside_tolerance << ",\n";
+    out << "  \"suggestions\": " << report.suggestions << ",\n";
+    out << "  \"merged_map_bucket_bytes\": " << report.bucket_bytes << ",\n";
+    out << "  \"elapsed_seconds\": " << report.elapsed_seconds << ",\n";
+    out << "  \"teardown_seconds\": " << report.teardown_seconds << ",\n";
+    out << "  \"memory\": [";
+    for (size_t i = 0; i < report.memory.size(); ++i) {
+        const MemPhase& phase = report.memory[i];
+        out << (i ? "," : "") << "\n    {\"phase\": \"" << json_escape(phase.name)
+            << "\", \"seconds\": " << phase.seconds
+            << ", \"arena_reserved_bytes\": " << phase.arena_reserved << ", \"structures\": {";
+        for (size_t c = 0; c < kMemCategories; ++c) {
+            out << (c ? ", " : "") << "\n      \"" << kMemCategoryNames[c] << "\": {\"live_bytes\": " << phase.live[c]
+                << ", \"peak_bytes\": " << phase.peak[c] << ", \"allocations\": " << phase.allocations[c] << "}";
+        }
+        out << "\n    }}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// ---------------------------------------------------------------------------
+// Matching unmatched instances by location (--nearest)
+// ---------------------------------------------------------------------------
+
+// Where an instance's placement is found in its file.
+struct LocationColumns {
+    int x = -1, y = -1;
+    int cell = -1;  // cell type column, or -1 to pair regardless of cell type
+};
+
+// An unmatched instance with its placement; `index` is its position in the missing list.
+struct LocatedInstance {
+    InstanceKey key;
+    size_t index = 0;
+    double x = 0, y = 0;
+    std::string cell;
+};
+
+// A pair of unmatched instances, one from each file, placed within the distance bound.
+struct LocationMatch {
+    size_t first, second;  // indices into the two LocatedInstance lists
+    double distance;
+};
+
+// Splits a line with the delimiter chosen at run time.
+inline size_t split_fields_as(Delimiter delim, const char* begin, const char* end, const char* limit,
+                              std::string_view* fields, size_t max_fields) {
+    switch (delim) {
+        case Delimiter::Comma: return split_fields<Delimiter::Comma>(begin, end, limit, fields, max_fields);
+        case Delimiter::Tab: return split_fields<Delimiter::Tab>(begin, end, limit, fields, max_fields);
+        default: return split_fields<Delimiter::Whitespace>(begin, end, limit, fields, max_fields);
+    }
+}
+
+// Reads the placement (and cell type) of the given keys with a second parallel pass over
+// the file. Only the lines of these keys are converted; as in the main parse, the last
+// line of a key wins. Keys without a readable placement are left out, as are (with a
+// warning) lines whose placement is not finite, such as 'inf' or 'nan'.
+std::vector<LocatedInstance> collect_locations(
+    const std::string& file_path, const std::vector<int>& inst_cols, const LocationColumns& cols,
+    const KeyList& keys, const ParseOptions& opts
+) {
+    std::vector<LocatedInstance> located;
+    if (keys.empty()) return located;
+    std::unordered_map<InstanceKey, size_t, InstanceKeyHash> wanted;
+    wanted.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) wanted.emplace(keys[i], i);
+
+    int max_col = std::max({cols.x, cols.y, cols.cell});
+    for (int col : inst_cols) max_col = std::max(max_col, col);
+    unsigned num_workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    auto chunks = find_chunk_boundaries(file_path, num_workers);
+
+    using Found = std::vector<std::pair<size_t, LocatedInstance>>;
+    std::vector<std::future<Found>> futures;
+    std::atomic<bool> complete{true};
+    std::atomic<uint64_t> non_finite{0};
+    for (const auto& chunk : chunks) {
+        futures.push_back(std::async(std::launch::async, [&, chunk] {
+            Found found;
+            std::vector<std::string_view> parts(max_col + 1);
+            std::vector<std::string_view> key_fields(inst_cols.size());
+            std::vector<char> norm_buf;
+            bool read = for_each_line(file_path, chunk.first, chunk.second, false, [&](const char* begin, const char* end, const char* limit, uint64_t) {
+                if (begin == end || *begin == '#' || *begin == '\r') return;
+                size_t n = split_fields_as(opts.delim, begin, end, limit, parts.data(), parts.size());
+                if (n <= static_cast<size_t>(max_col) || METADATA_KEYWORD_VIEWS.count(parts[0])) return;
+                for (size_t i = 0; i < inst_cols.size(); ++i) key_fields[i] = parts[inst_cols[i]];
+                if (opts.normalizer) {
+                    size_t needed = 0;
+                    for (const auto& field : key_fields) needed += field.size();
+                    if (norm_buf.size() < needed) norm_buf.resize(needed);
+                    char* out = norm_buf.data();
+                    for (auto& field : key_fields) out += opts.normalizer->apply(field, out);
+                }
+                auto it = wanted.find(InstanceKey(key_fields.data(), static_cast<uint32_t>(key_fields.size())));
+                if (it == wanted.end()) return;
+                LocatedInstance loc;
+                if (parse_number(parts[cols.x], loc.x) != NumParse::Ok || parse_number(parts[cols.y], loc.y) != NumParse::Ok) return;
+                if (!std::isfinite(loc.x) || !std::isfinite(loc.y)) {
+                    ++non_finite;
+                    return;
+                }
+                loc.key = it->first;
+                loc.index = it->second;
+                if (cols.cell >= 0) loc.cell = std::string(parts[cols.cell]);
+                found.emplace_back(it->second, std::move(loc));
+            });
+            if (!read) complete = false;
+            return found;
+        }));
+    }
+
+    // Chunks are in file order, so later lines overwrite earlier ones.
+    std::vector<std::optional<LocatedInstance>> by_index(keys.size());
+    for (auto& fut : futures) {
+        for (auto& entry : fut.get()) by_index[entry.first] = std::move(entry.second);
+    }
+    if (!complete) std::cerr << "Warning: Could not read all of " << file_path << "; some placements are missing." << std::endl;
+    if (non_finite) {
+        std::cerr << "Warning: Skipped " << non_finite << " lines of " << file_path << " whose placement is not finite." << std::endl;
+    }
+    for (auto& loc : by_index) {
+        if (loc) located.push_back(std::move(*loc));
+    }
+    return located;
+}
+
+// Uniform grid over a set of points. Cells are at least `max_dist` wide, so the nearest
+// point within `max_dist` of a query is in the query's cell or one of its 8 neighbours.
+class LocationGrid {
+public:
+    LocationGrid(const std::vector<LocatedInstance>& points, double max_dist, unsigned workers) : points_(points) {
+        double x1 = 0, y1 = 0;
+        x0_ = y0_ = 0;
+        if (!points.empty()) {
+            x0_ = x1 = points[0].x;
+            y0_ = y1 = points[0].y;
+        }
+        for (const auto& p : points) {
+            x0_ = std::min(x0_, p.x); x1 = std::max(x1, p.x);
+            y0_ = std::min(y0_, p.y); y1 = std::max(y1, p.y);
+        }
+        // About one point per cell, but never more cells than 4 per point.
+        double n = static_cast<double>(std::max<size_t>(1, points.size()));
+        cell_ = std::max({max_dist, std::sqrt(std::max(x1 - x0_, 1e-9) * std::max(y1 - y0_, 1e-9) / n), 1e-9});
+        for (;;) {
+            nx_ = cells_along(x1 - x0_);
+            ny_ = cells_along(y1 - y0_);
+            if (static_cast<double>(nx_) * ny_ <= 4 * n + 16) break;
+            cell_ *= 2;
+        }
+
+        // Cell ids are computed in parallel; one sort groups the points by cell.
+        std::vector<uint64_t> ids(points.size());
+        size_t step = (points.size() + workers - 1) / std::max(1u, workers);
+        std::vector<std::future<void>> futures;
+        for (size_t lo = 0; lo < points.size(); lo += step) {
+            futures.push_back(std::async(std::launch::async, [&, lo] {
+                for (size_t i = lo; i < std::min(points.size(), lo + step); ++i) {
+                    ids[i] = (static_cast<uint64_t>(cell_of(points[i].x, points[i].y)) << 32) | i;
+                }
+            }));
+        }
+        for (auto& fut : futures) fut.get();
+        std::sort(ids.begin(), ids.end());
+        order_.resize(ids.size());
+        start_.assign(nx_ * ny_ + 1, 0);
+        for (size_t i = 0; i < ids.size(); ++i) {
+            order_[i] = static_cast<uint32_t>(ids[i]);
+            ++start_[(ids[i] >> 32) + 1];
+        }
+        for (size_t c = 0; c < nx_ * ny_; ++c) start_[c + 1] += start_[c];
+    }
+
+    // Index of the point nearest to (x, y) within `max_dist` that `accept` allows, or -1.
+    template <typename Accept>
+    long nearest(double x, double y, double max_dist, Accept&& accept) const {
+        long best = -1;
+        double best_d2 = max_dist * max_dist;
+        // A query far outside the grid (or at a non-finite spot) gets an index two cells
+        // off the edge, so the neighbourhood loops below are empty.
+        long cx = grid_index((x - x0_) / cell_, -2, static_cast<long>(nx_) + 1);
+        long cy = grid_index((y - y0_) / cell_, -2, static_cast<long>(ny_) + 1);
+        for (long gy = std::max(0L, cy - 1); gy <= std::min<long>(ny_ - 1, cy + 1); ++gy) {
+            for (long gx = std::max(0L, cx - 1); gx <= std::min<long>(nx_ - 1, cx + 1); ++gx) {
+                size_t c = static_cast<size_t>(gy) * nx_ + static_cast<size_t>(gx);
+                for (uint32_t k = start_[c]; k < start_[c + 1]; ++k) {
+                    const LocatedInstance& p = points_[order_[k]];
+                    double dx = p.x - x, dy = p.y - y, d2 = dx * dx + dy * dy;
+                    if (d2 <= best_d2 && (best < 0 || d2 < best_d2 || order_[k] < static_cast<uint32_t>(best)) && accept(order_[k])) {
+                        best = order_[k];
+                        best_d2 = d2;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+private:
+    // Number of cells spanning `extent`. Extents near the double range can overflow to
+    // infinity; the count is capped, and an infinite cell size gives a single cell.
+    size_t cells_along(double extent) const {
+        double cells = extent / cell_;
+        if (cells != cells) return 1;
+        return cells < 1e9 ? static_cast<size_t>(cells) + 1 : static_cast<size_t>(1e9);
+    }
+
+    // floor(v) as a cell index clamped to [lo, hi]; NaN maps to `lo`.
+    static long grid_index(double v, long lo, long hi) {
+        v = std::floor(v);
+        if (!(v >= static_cast<double>(lo))) return lo;
+        return v <= static_cast<double>(hi) ? static_cast<long>(v) : hi;
+    }
+
+    uint32_t cell_of(double x, double y) const {
+        long gx = grid_index((x - x0_) / cell_, 0, static_cast<long>(nx_) - 1);
+        long gy = grid_index((y - y0_) / cell_, 0, static_cast<long>(ny_) - 1);
+        return static_cast<uint32_t>(static_cast<size_t>(gy) * nx_ + static_cast<size_t>(gx));
+    }
+
+    const std::vector<LocatedInstance>& points_;
+    double x0_, y0_, cell_;
+    size_t nx_ = 1, ny_ = 1;
+    std::vector<uint32_t> start_;  // first position in order_ of each cell
+    std::vector<uint32_t> order_;  // point indices grouped by cell
+};
+
+// Pairs the instances of `left` with those of `right` by nearest placement within
+// `max_dist`, requiring equal cell types when `same_cell` is set. Each round queries the
+// unpaired left instances in parallel, then keeps the closest proposal for each right
+// instance; a left instance that lost its candidate retries against the rest next round.
+std::vector<LocationMatch> match_by_location(
+    const std::vector<LocatedInstance>& left, const std::vector<LocatedInstance>& right,
+    double max_dist, bool same_cell, unsigned workers
+) {
+    constexpr int kMaxRounds = 4;
+    std::vector<LocationMatch> matches;
+    if (left.empty() || right.empty()) return matches;
+    LocationGrid grid(right, max_dist, workers);
+    std::vector<char> left_done(left.size(), 0), right_taken(right.size(), 0);
+
+    for (int round = 0; round < kMaxRounds; ++round) {
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < left.size(); ++i) {
+            if (!left_done[i]) pending.push_back(i);
+        }
+        size_t step = (pending.size() + workers - 1) / std::max(1u, workers);
+        std::vector<std::future<std::vector<LocationMatch>>> futures;
+        for (size_t lo = 0; lo < pending.size(); lo += step) {
+            futures.push_back(std::async(std::launch::async, [&, lo] {
+                std::vector<LocationMatch> proposals;
+                for (size_t k = lo; k < std::min(pending.size(), lo + step); ++k) {
+                    const LocatedInstance& q = left[pending[k]];
+                    long j = grid.nearest(q.x, q.y, max_dist, [&](size_t r) {
+                        return !right_taken[r] && (!same_cell || right[r].cell == q.cell);
+                    });
+                    if (j >= 0) proposals.push_back({pending[k], static_cast<size_t>(j), std::hypot(right[j].x - q.x, right[j].y - q.y)});
+                }
+                return proposals;
+            }));
+        }
+        std::vector<LocationMatch> proposals;
+        for (auto& fut : futures) {
+            auto part = fut.get();
+            proposals.insert(proposals.end(), part.begin(), part.end());
+        }
+        if (proposals.empty()) break;
+
+        std::sort(proposals.begin(), proposals.end(), [](const LocationMatch& a, const LocationMatch& b) {
+            return a.distance != b.distance ? a.distance < b.distance : a.first < b.first;
+        });
+        for (const auto& p : proposals) {
+            if (right_taken[p.second]) continue;
+            right_taken[p.second] = 1;
+            left_done[p.first] = 1;
+            matches.push_back(p);
+        }
+    }
+    return matches;
+}
+
+// Writes the instances paired by location, with their values where they were parsed.
+void write_location_matches(
+    const std::string& file1_name, const std::string& file2_name,
+    const std::vector<LocatedInstance>& left, const std::vector<LocatedInstance>& right,
+    const std::vector<LocationMatch>& matches,
+    const InstanceDataMap& data1, const InstanceDataMap& data2
+) {
+    std::ofstream out("location_matches.csv");
+    out << "Key_" << file1_name << ",Key_" << file2_name << ",Distance,Value_" << file1_name << ",Value_" << file2_name << "\n";
+    auto value_of = [](const InstanceDataMap& data, const InstanceKey& key) {
+        auto it = data.find(key);
+        return it != data.end() && it->second.first.resolved() ? it->second.first.text() : std::string_view();
+    };
+    for (const auto& m : matches) {
+        const InstanceKey& k1 = left[m.first].key;
+        const InstanceKey& k2 = right[m.second].key;
+        out << k1 << "," << k2 << "," << m.distance << "," << value_of(data1, k1) << "," << value_of(data2, k2) << "\n";
+    }
+}
+
+// Removes the entries at the flagged positions from a sorted key list, keeping its order.
+void remove_flagged(KeyList& keys, const std::vector<char>& flagged) {
+    size_t out = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!flagged[i]) keys[out++] = keys[i];
+    }
+    keys.erase(keys.begin() + out, keys.end());
+}
+
+// ---------------------------------------------------------------------------
+// Suggesting renamed keys by edit distance (--suggest)
+// ---------------------------------------------------------------------------
+
+// A missing key of file1 and the closest missing key of file2.
+struct KeySuggestion {
+    size_t first, second;  // indices into the two missing key lists
+    size_t distance;
+};
+
+// Levenshtein distance of `a` and `b` if it is at most `k`, else k + 1. The common prefix
+// and suffix (most of a hierarchical name) are skipped, only the band of 2k + 1 diagonals
+// is computed, and the scan stops as soon as a row exceeds `k`.
+// `prev` and `cur` are scratch rows reused across calls.
+size_t bounded_edit_distance(std::string_view a, std::string_view b, size_t k,
+                             std::vector<size_t>& prev, std::vector<size_t>& cur) {
+    const size_t inf = k + 1;
+    if ((a.size() > b.size() ? a.size() - b.size() : b.size() - a.size()) > k) return inf;
+    size_t common = 0;
+    while (common < a.size() && common < b.size() && a[common] == b[common]) ++common;
+    a.remove_prefix(common);
+    b.remove_prefix(common);
+    while (!a.empty() && !b.empty() && a.back() == b.back()) {
+        a.remove_suffix(1);
+        b.remove_suffix(1);
+    }
+    const size_t n = a.size(), m = b.size();
+    if (n == 0 || m == 0) return std::min(n + m, inf);
+    prev.resize(m + 1);
+    cur.resize(m + 1);
+    for (size_t j = 0; j <= m; ++j) prev[j] = j <= k ? j : inf;
+    for (size_t i = 1; i <= n; ++i) {
+        size_t lo = i > k ? i - k : 1, hi = std::min(m, i + k);
+        cur[lo - 1] = lo == 1 && i <= k ? i : inf;
+        size_t row_min = cur[lo - 1];
+        for (size_t j = lo; j <= hi; ++j) {
+            size_t v = std::min({prev[j - 1] + (a[i - 1] != b[j - 1]), prev[j] + 1, cur[j - 1] + 1});
+            cur[j] = std::min(v, inf);
+            row_min = std::min(row_min, cur[j]);
+        }
+        if (hi < m) cur[hi + 1] = inf;
+        if (row_min > k) return inf;
+        std::swap(prev, cur);
+    }
+    return std::min(prev[m], inf);
+}
+
+// Inverted index of q-grams over the keys of one side, for finding the keys within k
+// edits of a probe. An edit destroys at most q grams, so two strings within k edits
+// share a gram among the k*q + 1 rarest grams of each (prefix filtering), and only those
+// prefix grams are indexed and probed. Repeated grams are numbered so each occurrence is
+// distinct. Strings too short for the filter are kept in a list that short probes scan.
+class QGramIndex {
+public:
+    QGramIndex(const KeyList& keys, size_t q, size_t k, unsigned workers)
+        : keys_(keys), q_(q), k_(k), counts_(new std::atomic<uint32_t>[kCountSlots]()) {
+        // Gram frequencies only define the order that picks the rare prefix; a counter
+        // collision just makes a gram look more common, on both sides alike.
+        parallel_slices(keys.size(), workers, [&](size_t lo, size_t hi) {
+            std::vector<uint64_t> grams;
+            for (size_t i = lo; i < hi; ++i) {
+                grams_of(keys[i].display(), grams);
+                for (uint64_t g : grams) counts_[slot(g)].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        // Workers bucket (gram, key) postings by shard; each shard then builds its table
+        // from the buckets of all workers in key order.
+        const size_t shards = std::max(1u, workers);
+        shards_.resize(shards);
+        std::vector<std::vector<std::vector<std::pair<uint64_t, uint32_t>>>> buckets;
+        std::vector<std::vector<uint32_t>> shorts;
+        size_t step = std::max<size_t>(1, (keys.size() + shards - 1) / shards);
+        buckets.resize((keys.size() + step - 1) / step);
+        shorts.resize(buckets.size());
+        parallel_slices(keys.size(), static_cast<unsigned>(shards), [&](size_t lo, size_t hi) {
+            auto& mine = buckets[lo / step];
+            mine.resize(shards);
+            std::vector<uint64_t> grams;
+            for (size_t i = lo; i < hi; ++i) {
+                if (!prefix_of(keys[i].display(), grams)) shorts[lo / step].push_back(static_cast<uint32_t>(i));
+                for (uint64_t g : grams) mine[g % shards].emplace_back(g, static_cast<uint32_t>(i));
+            }
+        });
+        parallel_slices(shards, static_cast<unsigned>(shards), [&](size_t lo, size_t hi) {
+            for (size_t s = lo; s < hi; ++s) {
+                for (auto& mine : buckets) {
+                    if (mine.empty()) continue;
+                    for (const auto& posting : mine[s]) shards_[s][posting.first].push_back(posting.second);
+                }
+            }
+        });
+        for (auto& part : shorts) short_keys_.insert(short_keys_.end(), part.begin(), part.end());
+    }
+
+    // Per-thread buffers of closest().
+    struct Scratch {
+        std::vector<uint64_t> grams;
+        std::vector<uint32_t> candidates;
+        std::vector<size_t> row1, row2;
+    };
+
+    // Index of the indexed key closest to `probe` within k edits (the first in key order
+    // on ties) and its distance, or -1.
+    std::pair<long, size_t> closest(std::string_view probe, Scratch& scratch) const {
+        auto& cands = scratch.candidates;
+        cands.clear();
+        bool filtered = prefix_of(probe, scratch.grams);
+        for (uint64_t g : scratch.grams) {
+            const auto& shard = shards_[g % shards_.size()];
+            auto it = shard.find(g);
+            if (it != shard.end()) cands.insert(cands.end(), it->second.begin(), it->second.end());
+        }
+        if (!filtered) cands.insert(cands.end(), short_keys_.begin(), short_keys_.end());
+        std::sort(cands.begin(), cands.end());
+        cands.erase(std::unique(cands.begin(), cands.end()), cands.end());
+
+        long best = -1;
+        size_t best_d = k_ + 1;
+        for (uint32_t id : cands) {
+            // Candidates are in key order, so only a strictly closer one replaces the best.
+            size_t bound = best < 0 ? k_ : best_d - 1;
+            if (best >= 0 && best_d == 0) break;
+            size_t d = bounded_edit_distance(probe, keys_[id].display(), bound, scratch.row1, scratch.row2);
+            if (d <= bound) {
+                best = id;
+                best_d = d;
+            }
+        }
+        return {best, best_d};
+    }
+
+private:
+    static constexpr size_t kCountSlots = size_t(1) << 22;
+
+    // The grams of `s`, each tagged with its occurrence number among equal grams.
+    void grams_of(std::string_view s, std::vector<uint64_t>& grams) const {
+        grams.clear();
+        if (s.size() < q_) return;
+        for (size_t i = 0; i + q_ <= s.size(); ++i) {
+            uint64_t g = 0;
+            std::memcpy(&g, s.data() + i, q_);
+            grams.push_back(g);
+        }
+        std::sort(grams.begin(), grams.end());
+        for (size_t i = 1, occurrence = 0; i < grams.size(); ++i) {
+            occurrence = (grams[i] & kGramMask) == (grams[i - 1] & kGramMask) ? occurrence + 1 : 0;
+            grams[i] |= std::min<uint64_t>(occurrence, 255) << 56;
+        }
+    }
+
+    // Replaces `grams` with the k*q + 1 rarest grams of `s`. Returns false if `s` has
+    // fewer grams than that, so the prefix filter cannot rule anything out for it.
+    bool prefix_of(std::string_view s, std::vector<uint64_t>& grams) const {
+        grams_of(s, grams);
+        size_t keep = k_ * q_ + 1;
+        bool filtered = grams.size() >= keep;
+        if (grams.size() > keep) {
+            std::nth_element(grams.begin(), grams.begin() + keep, grams.end(), [&](uint64_t a, uint64_t b) {
+                uint32_t ca = counts_[slot(a)].load(std::memory_order_relaxed);
+                uint32_t cb = counts_[slot(b)].load(std::memory_order_relaxed);
+                return ca != cb ? ca < cb : a < b;
+            });
+            grams.resize(keep);
+        }
+        return filtered;
+    }
+
+    static size_t slot(uint64_t g) { return hash_bytes(reinterpret_cast<const char*>(&g), sizeof(g)) & (kCountSlots - 1); }
+
+    static constexpr uint64_t kGramMask = (uint64_t(1) << 56) - 1;
+
+    const KeyList& keys_;
+    size_t q_, k_;
+    std::unique_ptr<std::atomic<uint32_t>[]> counts_;
+    std::vector<std::unordered_map<uint64_t, std::vector<uint32_t>>> shards_;
+    std::vector<uint32_t> short_keys_;
+};
+
+// For each key of `left`, finds the closest key of `right` within `max_edits` using a
+// q-gram index over `right`. Index build and probes run on `workers` threads.
+std::vector<KeySuggestion> suggest_renamed_keys(
+    const KeyList& left, const KeyList& right, size_t q, size_t max_edits, unsigned workers
+) {
+    std::vector<KeySuggestion> suggestions;
+    if (left.empty() || right.empty()) return suggestions;
+    QGramIndex index(right, q, max_edits, workers);
+    std::vector<std::vector<KeySuggestion>> parts(std::max(1u, workers));
+    size_t step = std::max<size_t>(1, (left.size() + parts.size() - 1) / parts.size());
+    parallel_slices(left.size(), static_cast<unsigned>(parts.size()), [&](size_t lo, size_t hi) {
+        QGramIndex::Scratch scratch;
+        auto& out = parts[lo / step];
+        for (size_t i = lo; i < hi; ++i) {
+            auto best = index.closest(left[i].display(), scratch);
+            if (best.first >= 0) out.push_back({i, static_cast<size_t>(best.first), best.second});
+        }
+    });
+    for (auto& part : parts) suggestions.insert(suggestions.end(), part.begin(), part.end());
+    return suggestions;
+}
+
+// Writes the suggested correspondences between the keys missing on each side.
+void write_suggestions(
+    const std::string& file1_name, const std::string& file2_name,
+    const KeyList& left, const KeyList& right, const std::vector<KeySuggestion>& suggestions
+) {
+    std::ofstream out("suggested_matches.csv");
+    out << "Key_" << file1_name << ",Suggested_Key_" << file2_name << ",Edit_Distance\n";
+    for (const auto& s : suggestions) {
+        out << left[s.first] << "," << right[s.second] << "," << s.distance << "\n";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// profile subcommand
+// ---------------------------------------------------------------------------
+
+// Column counts above this are reported in a single overflow bucket.
+constexpr size_t kMaxProfileColumns = 64;
+
+struct ProfileStats {
+    uint64_t total_lines = 0;
+    uint64_t blank_lines = 0;
+    uint64_t metadata_lines = 0;
+    uint64_t data_lines = 0;
+    uint64_t keyed_lines = 0;
+    uint64_t key_len_min = UINT64_MAX;
+    uint64_t key_len_max = 0;
+    uint64_t key_len_sum = 0;
+    std::vector<uint64_t> column_counts = std::vector<uint64_t>(kMaxProfileColumns + 2, 0);
+    std::vector<uint64_t> col_present = std::vector<uint64_t>(kMaxProfileColumns, 0);
+    std::vector<uint64_t> col_numeric = std::vector<uint64_t>(kMaxProfileColumns, 0);
+    HyperLogLog keys;
+
+    void merge(const ProfileStats& o) {
+        total_lines += o.total_lines;
+        blank_lines += o.blank_lines;
+        metadata_lines += o.metadata_lines;
+        data_lines += o.data_lines;
+        keyed_lines += o.keyed_lines;
+        key_len_min = std::min(key_len_min, o.key_len_min);
+        key_len_max = std::max(key_len_max, o.key_len_max);
+        key_len_sum += o.key_len_sum;
+        for (size_t i = 0; i < column_counts.size(); ++i) column_counts[i] += o.column_counts[i];
+        for (size_t i = 0; i < kMaxProfileColumns; ++i) {
+            col_present[i] += o.col_present[i];
+            col_numeric[i] += o.col_numeric[i];
+        }
+        keys.merge(o.keys);
+    }
+};
+
+// Profiles the lines in [begin, end) of a mapped file. `limit` is the end of the mapping.
+ProfileStats profile_range(const char* begin, const char* end, const char* limit, const std::vector<int>& inst_cols) {
+    ProfileStats st;
+    std::string_view fields[kMaxProfileColumns];
+    std::vector<std::string_view> key_fields(inst_cols.size());
+    const char* p = begin;
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* eol = nl ? nl : end;
+        ++st.total_lines;
+
+        size_t n = tokenize_line(p, eol, limit, fields, kMaxProfileColumns);
+        if (n == 0) {
+            ++st.blank_lines;
+        } else if (*p == '#' || *p == '\r' || fields[0][0] == '#' || METADATA_KEYWORD_VIEWS.count(fields[0])) {
+            ++st.metadata_lines;
+        } else {
+            ++st.data_lines;
+            ++st.column_counts[std::min(n, kMaxProfileColumns + 1)];
+            size_t stored = std::min(n, kMaxProfileColumns);
+            for (size_t i = 0; i < stored; ++i) {
+                ++st.col_present[i];
+                st.col_numeric[i] += is_numeric_token(fields[i]);
+            }
+
+            bool has_key = true;
+            uint64_t len = inst_cols.empty() ? 0 : inst_cols.size() - 1;
+            for (size_t i = 0; i < inst_cols.size(); ++i) {
+                if (static_cast<size_t>(inst_cols[i]) >= stored) {
+                    has_key = false;
+                    break;
+                }
+                key_fields[i] = fields[inst_cols[i]];
+                len += key_fields[i].size();
+            }
+            if (has_key) {
+                ++st.keyed_lines;
+                st.keys.add(InstanceKey::hash_fields(key_fields.data(), static_cast<uint32_t>(key_fields.size())));
+                st.key_len_min = std::min(st.key_len_min, len);
+                st.key_len_max = std::max(st.key_len_max, len);
+                st.key_len_sum += len;
+            }
+        }
+        p = eol + 1;
+    }
+    return st;
+}
+
+int run_profile(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--file")) {
+        std::cerr << "❌ Error: profile requires --file <path>." << std::endl;
+        return 1;
+    }
+    std::vector<int> inst_cols;
+    try {
+        std::stringstream ss(args.count("--instcol") ? args["--instcol"] : "0");
+        std::string segment;
+        while (std::getline(ss, segment, ',')) inst_cols.push_back(std::stoi(segment));
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --instcol. Please provide comma-separated integers." << std::endl;
+        return 1;
+    }
+
+    const std::string& path = args["--file"];
+    auto t_start = std::chrono::high_resolution_clock::now();
+    MappedFile file(path);
+    if (!file.is_open()) {
+        std::cerr << "❌ Error: Cannot open file '" << path << "'" << std::endl;
+        return 1;
+    }
+
+    unsigned int num_workers = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Profiling " << path << " with " << num_workers << " workers..." << std::endl;
+
+    // Split the mapping into one range per worker, each ending just after a newline.
+    const char* base = file.data();
+    const char* limit = base + file.size();
+    std::vector<std::future<ProfileStats>> futures;
+    const char* start = base;
+    for (unsigned int i = 0; i < num_workers && start < limit; ++i) {
+        const char* end = (i == num_workers - 1) ? limit : start + (limit - start) / (num_workers - i);
+        if (end < limit) {
+            const char* nl = static_cast<const char*>(std::memchr(end, '\n', limit - end));
+            end = nl ? nl + 1 : limit;
+        }
+        futures.push_back(std::async(std::launch::async, profile_range, start, end, limit, std::cref(inst_cols)));
+        start = end;
+    }
+
+    ProfileStats st;
+    for (auto& fut : futures) st.merge(fut.get());
+
+    double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+    double avg_key = st.keyed_lines ? double(st.key_len_sum) / st.keyed_lines : 0.0;
+    uint64_t key_min = st.keyed_lines ? st.key_len_min : 0;
+    uint64_t distinct = static_cast<uint64_t>(std::llround(st.keys.estimate()));
+
+    std::cout << "\n===================================\n";
+    std::cout << "Profile of " << path << "\n";
+    std::cout << "===================================\n";
+    std::cout << "File size: " << file.size() << " bytes\n";
+    std::cout << "Total lines: " << st.total_lines << "\n";
+    std::cout << "Data lines: " << st.data_lines << "\n";
+    std::cout << "Metadata/comment lines: " << st.metadata_lines << "\n";
+    std::cout << "Blank lines: " << st.blank_lines << "\n";
+    std::cout << "Column count distribution:\n";
+    for (size_t n = 0; n < st.column_counts.size(); ++n) {
+        if (!st.column_counts[n]) continue;
+        std::cout << "  " << (n > kMaxProfileColumns ? ">" + std::to_string(kMaxProfileColumns) : std::to_string(n))
+                  << " columns: " << st.column_counts[n] << "\n";
+    }
+    std::cout << "Key length (min/max/avg): " << key_min << " / " << st.key_len_max << " / "
+              << std::fixed << std::setprecision(1) << avg_key << "\n";
+    std::cout << "Numeric ratio per column:\n";
+    for (size_t c = 0; c < kMaxProfileColumns && st.col_present[c]; ++c) {
+        std::cout << "  col " << c << ": " << std::setprecision(2)
+                  << 100.0 * st.col_numeric[c] / st.col_present[c] << "%\n";
+    }
+    std::cout << "Estimated distinct keys: " << distinct << "\n";
+    std::cout << "Profile time: " << std::setprecision(3) << elapsed << " seconds ("
+              << (elapsed > 0 ? file.size() / elapsed / 1e9 : 0.0) << " GB/s)\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    std::cout << "\nPROFILE_STATS:file_size=" << file.size() << "\n";
+    std::cout << "PROFILE_STATS:total_lines=" << st.total_lines << "\n";
+    std::cout << "PROFILE_STATS:data_lines=" << st.data_lines << "\n";
+    std::cout << "PROFILE_STATS:metadata_lines=" << st.metadata_lines << "\n";
+    std::cout << "PROFILE_STATS:blank_lines=" << st.blank_lines << "\n";
+    for (size_t n = 0; n < st.column_counts.size(); ++n) {
+        if (st.column_counts[n]) std::cout << "PROFILE_STATS:columns_" << n << "=" << st.column_counts[n] << "\n";
+    }
+    std::cout << "PROFILE_STATS:key_len_min=" << key_min << "\n";
+    std::cout << "PROFILE_STATS:key_len_max=" << st.key_len_max << "\n";
+    std::cout << "PROFILE_STATS:key_len_avg=" << avg_key << "\n";
+    for (size_t c = 0; c < kMaxProfileColumns && st.col_present[c]; ++c) {
+        std::cout << "PROFILE_STATS:numeric_ratio_col" << c << "=" << double(st.col_numeric[c]) / st.col_present[c] << "\n";
+    }
+    std::cout << "PROFILE_STATS:distinct_keys_estimate=" << distinct << std::endl;
+    return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// fetch subcommand
+// ---------------------------------------------------------------------------
+
+int run_fetch(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--file") || !args.count("--key")) {
+        std::cerr << "❌ Error: fetch requires --file <path> and --key <key>." << std::endl;
+        return 1;
+    }
+    const std::string& path = args["--file"];
+    const std::string& key = args["--key"];
+    LineIndex index;
+    if (!load_line_index(path, index)) {
+        std::cerr << "❌ Error: No valid line index for '" << path << "'. Run a comparison with --index first." << std::endl;
+        return 1;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "❌ Error: Cannot open file '" << path << "'" << std::endl;
+        return 1;
+    }
+
+    int max_col = 0;
+    for (int c : index.inst_cols) max_col = std::max(max_col, c);
+    std::vector<std::string_view> fields(max_col + 1);
+
+    uint64_t line_no = 0, blocks_read = 0, found = 0;
+    std::string line, line_key;
+    for (const auto& b : index.blocks) {
+        if (b.keys && key >= b.key_min && key <= b.key_max) {
+            ++blocks_read;
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(b.offset));
+            for (uint64_t i = 0; i < b.lines && std::getline(file, line); ++i) {
+                const char* end = line.data() + line.size();
+                if (tokenize_line(line.data(), end, end, fields.data(), fields.size()) <= static_cast<size_t>(max_col)) continue;
+                line_key.clear();
+                for (size_t c = 0; c < index.inst_cols.size(); ++c) {
+                    if (c) line_key += "|";
+                    line_key += fields[index.inst_cols[c]];
+                }
+                if (line_key == key) {
+                    std::cout << path << ":" << line_no + i + 1 << ": " << line << "\n";
+                    ++found;
+                }
+            }
+        }
+        line_no += b.lines;
+    }
+    std::cerr << found << " line(s) found, " << blocks_read << " of " << index.blocks.size() << " index blocks read." << std::endl;
+    return found ? 0 : 2;
+}
+
+// ---------------------------------------------------------------------------
+// microbench subcommand
+// ---------------------------------------------------------------------------
+
+// Best-of-`repeat` time in seconds for one LineParser instantiation to parse every line
+// of `text`, which is followed by at least 16 readable padding bytes.
+template <typename Parser>
+double time_line_parser(const std::vector<char>& text, size_t text_size, const std::vector<int>& inst_cols,
+                        int value_col, const ParseOptions& opts, int repeat, size_t& instances) {
+    double best = 1e30;
+    for (int r = 0; r < repeat; ++r) {
+        Region region;
+        Parser parser(inst_cols, value_col, region.new_worker(), opts);
+        const char* p = text.data();
+        const char* stop = text.data() + text_size;
+        const char* limit = text.data() + text.size();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        while (p < stop) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', stop - p));
+            if (!nl) nl = stop;
+            parser.parse_line(p, nl, limit, static_cast<uint64_t>(p - text.data()));
+            p = nl + 1;
+        }
+        best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count());
+        instances = parser.size();
+    }
+    return best;
+}
+
+// Times every specialized parse kernel against the generic one on the head of a file.
+// Key columns 1..4 use the first columns other than the value column.
+int run_microbench(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--file")) {
+        std::cerr << "❌ Error: microbench requires --file <path>." << std::endl;
+        return 1;
+    }
+    int value_col;
+    int repeat;
+    uint64_t max_bytes;
+    try {
+        value_col = std::stoi(args.count("--valcol") ? args["--valcol"] : "1");
+        repeat = std::max(1, std::stoi(args.count("--repeat") ? args["--repeat"] : "3"));
+        max_bytes = std::stoull(args.count("--max_mb") ? args["--max_mb"] : "256") << 20;
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --valcol, --repeat or --max_mb." << std::endl;
+        return 1;
+    }
+    ParseOptions opts;
+    if (args["--delim"] == "comma" || args["--delim"] == ",") opts.delim = Delimiter::Comma;
+    else if (args["--delim"] == "tab") opts.delim = Delimiter::Tab;
+
+    // Load whole lines from the head of the file.
+    std::ifstream file(args["--file"], std::ios::binary);
+    if (!file) {
+        std::cerr << "❌ Error: Cannot open file '" << args["--file"] << "'" << std::endl;
+        return 1;
+    }
+    std::vector<char> text(max_bytes + 16);
+    file.read(text.data(), static_cast<std::streamsize>(max_bytes));
+    size_t text_size = static_cast<size_t>(file.gcount());
+    if (text_size == max_bytes) {
+        while (text_size > 0 && text[text_size - 1] != '\n') --text_size;
+    }
+    text.resize(text_size + 16);
+    size_t lines = static_cast<size_t>(std::count(text.data(), text.data() + text_size, '\n'));
+    std::cout << "Parse kernel microbenchmark on " << text_size << " bytes (" << lines << " lines) of "
+              << args["--file"] << ", best of " << repeat << "\n\n";
+
+    const char* mode_names[] = {"numeric", "string", "raw", "decimal"};
+    const ValueMode modes[] = {ValueMode::Numeric, ValueMode::String, ValueMode::Raw, ValueMode::Decimal};
+    std::cout << std::left << std::setw(6) << "keys" << std::setw(10) << "mode" << std::right
+              << std::setw(16) << "generic Ml/s" << std::setw(20) << "specialized Ml/s" << std::setw(10) << "speedup" << "\n";
+    for (int m = 0; m < 4; ++m) {
+        for (size_t k = 1; k <= 4; ++k) {
+            std::vector<int> inst_cols;
+            for (int c = 0; inst_cols.size() < k; ++c) {
+                if (c != value_col) inst_cols.push_back(c);
+            }
+            size_t n_generic = 0, n_special = 0;
+            double t_generic = with_line_parser(0, opts.delim, modes[m], [&](auto tag) {
+                return time_line_parser<typename decltype(tag)::type>(text, text_size, inst_cols, value_col, opts, repeat, n_generic);
+            });
+            double t_special = with_line_parser(k, opts.delim, modes[m], [&](auto tag) {
+                return time_line_parser<typename decltype(tag)::type>(text, text_size, inst_cols, value_col, opts, repeat, n_special);
+            });
+            std::cout << std::left << std::setw(6) << k << std::setw(10) << mode_names[m] << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(16) << lines / t_generic / 1e6
+                      << std::setw(20) << lines / t_special / 1e6 << std::setw(9) << t_generic / t_special << "x"
+                      << (n_generic != n_special ? "  (instance counts differ!)" : "") << "\n";
+        }
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Run history store (--history, history subcommand)
+// ---------------------------------------------------------------------------
+//
+// A history directory collects the per-instance results of every run appended to it:
+//   keys.dict    the instance keys, numbered in order of first appearance; a run appends
+//                the keys no earlier run had
+//   run_<n>.chs  one segment per run: its rows sorted by key number and cut into blocks
+//                of kHistoryBlockRows rows, each block stored column by column
+// A segment's header holds every block's key number range and the position of each of its
+// columns, so a query reads only the blocks that can hold its keys, and of those only the
+// columns it needs. Key numbers are delta-coded, statuses run-length coded and values kept
+// as the shortest decimal that reads back as the same double. Segments are written under
+// a temporary name and renamed, so readers never see a partial run.
+
+enum HistoryColumn { kHistKey, kHistStatus, kHistValue1, kHistValue2, kHistColumns };
+
+// Whether a key was in both files of a run or only in one.
+enum HistoryStatus : uint8_t { kHistMatched, kHistOnlyInFile1, kHistOnlyInFile2 };
+
+constexpr size_t kHistoryBlockRows = 16384;
+constexpr char kHistoryMagic[8] = {'C', 'M', 'P', 'H', 'I', 'S', '0', '1'};
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+// Appends a double as the shortest decimal that reads back as the same value: a varint
+// exponent (0, 1 and 2 stand for NaN, +inf and -inf) and a zigzag varint of the digits.
+// Values read from text have few digits, so most take 3-5 bytes.
+inline void put_decimal(std::string& out, double v) {
+    if (std::isnan(v)) return put_varint(out, 0);
+    if (std::isinf(v)) return put_varint(out, v > 0 ? 1 : 2);
+    char buf[32];
+    const char* end = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::scientific).ptr;
+    const char* p = buf;
+    bool negative = *p == '-';
+    p += negative;
+    int64_t digits = 0;
+    int count = 0;
+    for (; p < end && *p != 'e'; ++p) {
+        if (*p == '.') continue;
+        digits = digits * 10 + (*p - '0');
+        ++count;
+    }
+    int exponent = 0;
+    p += 1 + (p + 1 < end && p[1] == '+');
+    std::from_chars(p, end, exponent);
+    put_varint(out, zigzag(exponent - (count - 1)) + 3);
+    put_varint(out, zigzag(negative ? -digits : digits));
+}
+
+inline bool get_decimal(const char*& p, const char* end, double& v) {
+    uint64_t head, digits;
+    if (!get_varint(p, end, head)) return false;
+    if (head < 3) {
+        v = head == 0 ? std::numeric_limits<double>::quiet_NaN()
+          : head == 1 ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+        return true;
+    }
+    if (!get_varint(p, end, digits)) return false;
+    char buf[48];
+    char* q = std::to_chars(buf, buf + 24, unzigzag(digits)).ptr;
+    *q++ = 'e';
+    q = std::to_chars(q, buf + sizeof(buf), unzigzag(head - 3)).ptr;
+    return std::from_chars(buf, q, v).ec == std::errc();
+}
+
+// The key dictionary of a history store. Keys are views into the loaded file.
+class HistoryKeys {
+public:
+    HistoryKeys() = default;
+    HistoryKeys(const HistoryKeys&) = delete;
+    HistoryKeys& operator=(const HistoryKeys&) = delete;
+
+    // Loads '<dir>/keys.dict'; a missing file is an empty dictionary. `with_lookup` also
+    // builds the key-to-number map that appending needs.
+    bool load(const std::string& dir, bool with_lookup) {
+        std::ifstream f(dir + "/keys.dict", std::ios::binary);
+        if (!f) return true;
+        buf_.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        const char* p = buf_.data();
+        const char* end = p + buf_.size();
+        while (p < end) {
+            uint64_t n;
+            if (!get_varint(p, end, n) || n > static_cast<uint64_t>(end - p)) return false;
+            keys_.emplace_back(p, n);
+            p += n;
+        }
+        if (with_lookup) {
+            numbers_.reserve(keys_.size());
+            for (size_t i = 0; i < keys_.size(); ++i) numbers_.emplace(keys_[i], static_cast<uint32_t>(i));
+        }
+        return true;
+    }
+
+    // The number of `key`, or UINT32_MAX if it is not in the dictionary.
+    uint32_t find(std::string_view key) const {
+        auto it = numbers_.find(key);
+        return it == numbers_.end() ? UINT32_MAX : it->second;
+    }
+    std::string_view key(uint32_t number) const { return keys_[number]; }
+    size_t size() const { return keys_.size(); }
+
+    // Appends `added` to '<dir>/keys.dict'; they are numbered from size() on.
+    static bool append(const std::string& dir, const std::vector<std::string_view>& added) {
+        std::string out;
+        for (std::string_view k : added) {
+            put_varint(out, k.size());
+            out += k;
+        }
+        std::ofstream f(dir + "/keys.dict", std::ios::binary | std::ios::app);
+        f.write(out.data(), out.size());
+        return static_cast<bool>(f);
+    }
+
+private:
+    std::string buf_;
+    std::vector<std::string_view> keys_;
+    std::unordered_map<std::string_view, uint32_t> numbers_;
+};
+
+struct HistoryBlock {
+    uint64_t min_key = 0, max_key = 0, rows = 0;
+    std::array<uint64_t, kHistColumns> offset{}, length{};  // column positions in the file
+};
+
+// The header of one run's segment.
+struct HistorySegment {
+    std::string path;
+    uint64_t run = 0;
+    int64_t time = 0;
+    std::string file1, file2;
+    uint64_t rows = 0;
+    std::vector<HistoryBlock> blocks;
+};
+
+// One instance's results in one run.
+struct HistoryRow {
+    uint32_t key;
+    uint8_t status;
+    double value1, value2;
+};
+
+inline std::string history_segment_path(const std::string& dir, uint64_t run) {
+    return dir + "/run_" + std::to_string(run) + ".chs";
+}
+
+// Loads the header of a segment file.
+bool load_history_segment(const std::string& path, HistorySegment& seg) {
+    std::ifstream f(path, std::ios::binary);
+    char head[sizeof(kHistoryMagic) + 4];
+    if (!f.read(head, sizeof(head)) || std::memcmp(head, kHistoryMagic, sizeof(kHistoryMagic)) != 0) return false;
+    uint32_t header_size;
+    std::memcpy(&header_size, head + sizeof(kHistoryMagic), 4);
+    std::string buf(header_size, '\0');
+    if (!f.read(&buf[0], header_size)) return false;
+
+    const char* p = buf.data();
+    const char* end = p + buf.size();
+    uint64_t time, nblocks;
+    if (!get_varint(p, end, seg.run) || !get_varint(p, end, time) || !get_bytes(p, end, seg.file1) ||
+        !get_bytes(p, end, seg.file2) || !get_varint(p, end, seg.rows) || !get_varint(p, end, nblocks)) return false;
+    seg.path = path;
+    seg.time = static_cast<int64_t>(time);
+    seg.blocks.assign(nblocks, HistoryBlock());
+    uint64_t offset = sizeof(head) + header_size;
+    for (auto& b : seg.blocks) {
+        uint64_t span;
+        if (!get_varint(p, end, b.min_key) || !get_varint(p, end, span) || !get_varint(p, end, b.rows)) return false;
+        b.max_key = b.min_key + span;
+        for (size_t c = 0; c < kHistColumns; ++c) {
+            if (!get_varint(p, end, b.length[c])) return false;
+            b.offset[c] = offset;
+            offset += b.length[c];
+        }
+    }
+    return true;
+}
+
+// The segments of a history store, in run order.
+std::vector<HistorySegment> list_history_segments(const std::string& dir) {
+    std::vector<HistorySegment> segments;
+    DIR* d = ::opendir(dir.c_str());
+    if (!d) return segments;
+    while (dirent* entry = ::readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.rfind("run_", 0) != 0 || name.size() < 8 || name.compare(name.size() - 4, 4, ".chs") != 0) continue;
+        HistorySegment seg;
+        if (load_history_segment(dir + "/" + name, seg)) {
+            segments.push_back(std::move(seg));
+        } else {
+            std::cerr << "Warning: Skipping unreadable history segment " << dir << "/" << name << std::endl;
+        }
+    }
+    ::closedir(d);
+    std::sort(segments.begin(), segments.end(), [](const HistorySegment& a, const HistorySegment& b) { return a.run < b.run; });
+    return segments;
+}
+
+// Encodes the columns of one block of rows.
+std::array<std::string, kHistColumns> encode_history_block(const HistoryRow* rows, size_t n) {
+    std::array<std::string, kHistColumns> cols;
+    uint32_t prev_key = rows[0].key;
+    for (size_t i = 0; i < n; ++i) {
+        put_varint(cols[kHistKey], rows[i].key - prev_key);
+        prev_key = rows[i].key;
+        put_decimal(cols[kHistValue1], rows[i].value1);
+        put_decimal(cols[kHistValue2], rows[i].value2);
+    }
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && rows[j].status == rows[i].status) ++j;
+        put_varint(cols[kHistStatus], j - i);
+        cols[kHistStatus].push_back(static_cast<char>(rows[i].status));
+        i = j;
+    }
+    return cols;
+}
+
+// Appends the results of a run (the values of every key of either file) to the history
+// store in `dir`, creating it if needed. A lock file serializes concurrent appends.
+// Returns the run number, or 0 with a message in `error`.
+uint64_t append_history(
+    const std::string& dir, const std::string& file1, const std::string& file2,
+    const InstanceDataMap& data1, const InstanceDataMap& data2,
+    const KeyList& matched, const KeyList& only_in_file1, const KeyList& only_in_file2,
+    unsigned workers, size_t& added_keys, std::string& error
+) {
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "Cannot create history directory '" + dir + "'";
+        return 0;
+    }
+    int lock = ::open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock < 0 || ::flock(lock, LOCK_EX) != 0) {
+        if (lock >= 0) ::close(lock);
+        error = "Cannot lock history directory '" + dir + "'";
+        return 0;
+    }
+    struct Unlock {
+        int fd;
+        ~Unlock() { ::close(fd); }
+    } unlock{lock};
+
+    HistoryKeys keys;
+    if (!keys.load(dir, true)) {
+        error = "Corrupt key dictionary in '" + dir + "'";
+        return 0;
+    }
+    auto value_of = [](const InstanceDataMap& data, const InstanceKey& key) {
+        auto it = data.find(key);
+        double v;
+        return it != data.end() && numeric_value(it->second.second, v) ? v : std::numeric_limits<double>::quiet_NaN();
+    };
+
+    // Look the keys up in parallel; keys new to the store are numbered afterwards in key
+    // order, so the keys under a prefix get nearby numbers and share few blocks.
+    std::vector<HistoryRow> rows(matched.size() + only_in_file1.size() + only_in_file2.size());
+    std::vector<const InstanceKey*> row_keys(rows.size());
+    size_t base = 0;
+    for (auto [list, status] : {std::make_pair(&matched, kHistMatched), std::make_pair(&only_in_file1, kHistOnlyInFile1),
+                                std::make_pair(&only_in_file2, kHistOnlyInFile2)}) {
+        parallel_slices(list->size(), workers, [&, list = list, status = status, base](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; ++i) {
+                const InstanceKey& key = (*list)[i];
+                HistoryRow& row = rows[base + i];
+                row.key = keys.find(key.display());
+                row.status = status;
+                row.value1 = status == kHistOnlyInFile2 ? std::numeric_limits<double>::quiet_NaN() : value_of(data1, key);
+                row.value2 = status == kHistOnlyInFile1 ? std::numeric_limits<double>::quiet_NaN() : value_of(data2, key);
+                row_keys[base + i] = &key;
+            }
+        });
+        base += list->size();
+    }
+    std::vector<size_t> fresh;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i].key == UINT32_MAX) fresh.push_back(i);
+    }
+    std::sort(fresh.begin(), fresh.end(), [&](size_t a, size_t b) { return key_display_less(*row_keys[a], *row_keys[b]); });
+    std::vector<std::string_view> added;
+    for (size_t i : fresh) {
+        rows[i].key = static_cast<uint32_t>(keys.size() + added.size());
+        added.push_back(row_keys[i]->display());
+    }
+    if (keys.size() + added.size() >= UINT32_MAX) {
+        error = "History key dictionary is full";
+        return 0;
+    }
+    std::sort(rows.begin(), rows.end(), [](const HistoryRow& a, const HistoryRow& b) { return a.key < b.key; });
+
+    size_t nblocks = (rows.size() + kHistoryBlockRows - 1) / kHistoryBlockRows;
+    std::vector<std::array<std::string, kHistColumns>> blocks(nblocks);
+    parallel_slices(nblocks, workers, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b < hi; ++b) {
+            size_t first = b * kHistoryBlockRows, n = std::min(kHistoryBlockRows, rows.size() - first);
+            blocks[b] = encode_history_block(rows.data() + first, n);
+        }
+    });
+
+    uint64_t run = 1;
+    for (const auto& seg : list_history_segments(dir)) run = std::max(run, seg.run + 1);
+    std::string header;
+    put_varint(header, run);
+    put_varint(header, static_cast<uint64_t>(std::time(nullptr)));
+    put_varint(header, file1.size());
+    header += file1;
+    put_varint(header, file2.size());
+    header += file2;
+    put_varint(header, rows.size());
+    put_varint(header, nblocks);
+    for (size_t b = 0; b < nblocks; ++b) {
+        size_t first = b * kHistoryBlockRows, last = std::min(rows.size(), first + kHistoryBlockRows) - 1;
+        put_varint(header, rows[first].key);
+        put_varint(header, rows[last].key - rows[first].key);
+        put_varint(header, last - first + 1);
+        for (const auto& col : blocks[b]) put_varint(header, col.size());
+    }
+
+    // The dictionary goes first: a segment must never refer to keys it doesn't hold.
+    if (!added.empty() && !HistoryKeys::append(dir, added)) {
+        error = "Cannot append to the key dictionary in '" + dir + "'";
+        return 0;
+    }
+    std::string path = history_segment_path(dir, run), tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        uint32_t header_size = static_cast<uint32_t>(header.size());
+        out.write(kHistoryMagic, sizeof(kHistoryMagic));
+        out.write(reinterpret_cast<const char*>(&header_size), 4);
+        out.write(header.data(), header.size());
+        for (const auto& block : blocks) {
+            for (const auto& col : block) out.write(col.data(), col.size());
+        }
+        if (!out) {
+            error = "Cannot write history segment '" + tmp + "'";
+            return 0;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        error = "Cannot rename history segment '" + tmp + "'";
+        return 0;
+    }
+    added_keys = added.size();
+    return run;
+}
+
+// Reads the rows of the keys flagged in `wanted` from one segment. Only blocks whose key
+// range overlaps [lo, hi] are read, and their status and value columns only if the key
+// column holds a wanted key. Returns false if the file can't be read.
+bool scan_history_segment(const HistorySegment& seg, const std::vector<char>& wanted, uint64_t lo, uint64_t hi,
+                          std::vector<HistoryRow>& rows, size_t& blocks_read) {
+    int fd = ::open(seg.path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    std::string buf;
+    auto read_column = [&](const HistoryBlock& b, HistoryColumn c) {
+        buf.resize(b.length[c]);
+        return ::pread(fd, &buf[0], buf.size(), static_cast<off_t>(b.offset[c])) == static_cast<ssize_t>(buf.size());
+    };
+    bool ok = true;
+    std::vector<uint32_t> block_keys;
+    std::vector<uint32_t> hits;
+    for (const auto& b : seg.blocks) {
+        if (b.max_key < lo || b.min_key > hi) continue;
+        ++blocks_read;
+        if (!(ok = read_column(b, kHistKey))) break;
+        const char* p = buf.data();
+        const char* end = p + buf.size();
+        block_keys.resize(b.rows);
+        hits.clear();
+        uint64_t key = b.min_key;
+        for (uint64_t i = 0; i < b.rows; ++i) {
+            uint64_t delta;
+            if (!(ok = get_varint(p, end, delta))) break;
+            key += delta;
+            block_keys[i] = static_cast<uint32_t>(key);
+            if (key < wanted.size() && wanted[key]) hits.push_back(static_cast<uint32_t>(i));
+        }
+        if (!ok) break;
+        if (hits.empty()) continue;
+
+        // Decode the other columns up to the last hit.
+        size_t first = rows.size();
+        for (uint32_t i : hits) rows.push_back({block_keys[i], 0, 0, 0});
+        if (!(ok = read_column(b, kHistStatus))) break;
+        p = buf.data();
+        end = p + buf.size();
+        uint64_t run_end = 0, run_length;
+        uint8_t status = 0;
+        for (size_t h = 0, i = 0; h < hits.size(); ++i) {
+            if (i == run_end) {
+                if (!(ok = get_varint(p, end, run_length) && p < end)) break;
+                status = static_cast<uint8_t>(*p++);
+                run_end += run_length;
+            }
+            if (i == hits[h]) rows[first + h++].status = status;
+        }
+        for (HistoryColumn c : {kHistValue1, kHistValue2}) {
+            if (!ok || !(ok = read_column(b, c))) break;
+            p = buf.data();
+            end = p + buf.size();
+            double v;
+            for (size_t h = 0, i = 0; ok && h < hits.size(); ++i) {
+                ok = get_decimal(p, end, v);
+                if (!ok || i != hits[h]) continue;
+                (c == kHistValue1 ? rows[first + h].value1 : rows[first + h].value2) = v;
+                ++h;
+            }
+        }
+        if (!ok) break;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// Deviation of a matched row in percent, as in comparison.csv; NaN if a value isn't numeric.
+inline double history_deviation(const HistoryRow& row) {
+    if (row.status != kHistMatched || std::isnan(row.value1) || std::isnan(row.value2)) return std::numeric_limits<double>::quiet_NaN();
+    return row.value2 != 0 ? (row.value1 - row.value2) / row.value2 * 100 : std::numeric_limits<double>::infinity();
+}
+
+// Lists the runs of a history store, prints the deviation series of the instances under a
+// prefix, or lists the instances whose deviation grew over the last runs.
+int run_history(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--dir")) {
+        std::cerr << "❌ Error: history requires --dir <path>." << std::endl;
+        return 1;
+    }
+    const std::string& dir = args["--dir"];
+    size_t last = 0, regressed = 0;
+    double min_change = 0;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        if (args.count("--last")) last = std::stoul(args["--last"]);
+        if (args.count("--regressed")) regressed = std::stoul(args["--regressed"]);
+        if (args.count("--min_change")) min_change = std::stod(args["--min_change"]);
+        if (args.count("--threads")) workers = std::max(1ul, std::stoul(args["--threads"]));
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --last, --regressed, --min_change or --threads. Please provide a number." << std::endl;
+        return 1;
+    }
+    if (args.count("--regressed") && regressed == 0) {
+        std::cerr << "❌ Error: --regressed needs a number of runs >= 1." << std::endl;
+        return 1;
+    }
+    auto segments = list_history_segments(dir);
+    if (segments.empty()) {
+        std::cerr << "❌ Error: No runs in history '" << dir << "'." << std::endl;
+        return 1;
+    }
+    if (!args.count("--prefix") && !args.count("--regressed")) {
+        std::cout << "run,time,file1,file2,instances\n";
+        for (const auto& seg : segments) {
+            std::cout << seg.run << "," << seg.time << "," << seg.file1 << "," << seg.file2 << "," << seg.rows << "\n";
+        }
+        return 0;
+    }
+
+    HistoryKeys keys;
+    if (!keys.load(dir, false)) {
+        std::cerr << "❌ Error: Corrupt key dictionary in '" << dir << "'." << std::endl;
+        return 1;
+    }
+    // A regression query compares the newest run with the one `regressed` runs before it.
+    if (regressed) {
+        if (regressed >= segments.size()) {
+            std::cerr << "❌ Error: --regressed " << regressed << " needs more than " << regressed << " runs; the history has "
+                      << segments.size() << "." << std::endl;
+            return 1;
+        }
+        segments = {segments[segments.size() - 1 - regressed], segments.back()};
+    } else if (last && last < segments.size()) {
+        segments.erase(segments.begin(), segments.end() - last);
+    }
+
+    // The keys under the prefix, as flags by key number and their number range.
+    std::string prefix = args.count("--prefix") ? args["--prefix"] : std::string();
+    std::vector<char> wanted(keys.size(), 0);
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys.key(static_cast<uint32_t>(i)).substr(0, prefix.size()) != prefix) continue;
+        wanted[i] = 1;
+        lo = std::min<uint64_t>(lo, i);
+        hi = i;
+    }
+
+    std::vector<std::vector<HistoryRow>> rows(segments.size());
+    std::vector<size_t> blocks_read(segments.size(), 0);
+    std::vector<char> failed(segments.size(), 0);
+    parallel_slices(segments.size(), workers, [&](size_t first, size_t end) {
+        for (size_t s = first; s < end; ++s) failed[s] = !scan_history_segment(segments[s], wanted, lo, hi, rows[s], blocks_read[s]);
+    });
+    size_t total_blocks = 0, read = 0;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        if (failed[s]) {
+            std::cerr << "❌ Error: Cannot read history segment " << segments[s].path << std::endl;
+            return 1;
+        }
+        total_blocks += segments[s].blocks.size();
+        read += blocks_read[s];
+    }
+
+    // Rows are sorted by key number; output is in key order.
+    auto by_key = [&](uint32_t a, uint32_t b) { return keys.key(a) < keys.key(b); };
+    if (regressed) {
+        struct Regression {
+            uint32_t key;
+            double before, after;
+        };
+        std::vector<Regression> found;
+        const auto& before = rows[0];
+        const auto& after = rows[1];
+        for (size_t i = 0, j = 0; i < before.size() && j < after.size();) {
+            if (before[i].key != after[j].key) {
+                (before[i].key < after[j].key ? i : j)++;
+                continue;
+            }
+            double d0 = std::fabs(history_deviation(before[i])), d1 = std::fabs(history_deviation(after[j]));
+            if (!std::isnan(d0) && !std::isnan(d1) && d1 - d0 > min_change) found.push_back({after[j].key, d0, d1});
+            ++i;
+            ++j;
+        }
+        std::sort(found.begin(), found.end(), [&](const Regression& a, const Regression& b) {
+            double ca = a.after - a.before, cb = b.after - b.before;
+            return ca != cb ? ca > cb : by_key(a.key, b.key);
+        });
+        std::cout << "Key,Abs_Deviation_Run" << segments[0].run << ",Abs_Deviation_Run" << segments[1].run << ",Change\n";
+        for (const auto& r : found) {
+            std::cout << keys.key(r.key) << "," << r.before << "%," << r.after << "%," << r.after - r.before << "\n";
+        }
+        std::cerr << found.size() << " instance(s) regressed, " << read << " of " << total_blocks << " blocks read." << std::endl;
+        return 0;
+    }
+
+    // One row per key, one column per run: the deviation, 'missing' if the key was only in
+    // one file, 'N/A' for non-numeric values and empty if the run didn't have the key.
+    std::vector<uint32_t> order;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (wanted[i]) order.push_back(static_cast<uint32_t>(i));
+    }
+    std::sort(order.begin(), order.end(), by_key);
+    std::vector<uint32_t> position(keys.size(), 0);
+    for (size_t i = 0; i < order.size(); ++i) position[order[i]] = static_cast<uint32_t>(i);
+    struct Cell {
+        float deviation = 0;
+        uint8_t state = 0;  // 0 absent, 1 matched, 2 missing
+    };
+    std::vector<Cell> table(order.size() * segments.size());
+    for (size_t s = 0; s < segments.size(); ++s) {
+        for (const auto& row : rows[s]) {
+            Cell& cell = table[position[row.key] * segments.size() + s];
+            cell.state = row.status == kHistMatched ? 1 : 2;
+            cell.deviation = static_cast<float>(history_deviation(row));
+        }
+    }
+    std::cout << "Key";
+    for (const auto& seg : segments) std::cout << ",Deviation_Run" << seg.run;
+    std::cout << "\n";
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::cout << keys.key(order[i]);
+        for (size_t s = 0; s < segments.size(); ++s) {
+            const Cell& cell = table[i * segments.size() + s];
+            std::cout << ",";
+            if (cell.state == 2) std::cout << "missing";
+            else if (cell.state == 1 && std::isnan(cell.deviation)) std::cout << "N/A";
+            else if (cell.state == 1) std::cout << cell.deviation << "%";
+        }
+        std::cout << "\n";
+    }
+    std::cerr << order.size() << " instance(s) over " << segments.size() << " run(s), " << read << " of "
+              << total_blocks << " blocks read." << std::endl;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Parsed file snapshots (--snapshot, lookup subcommand)
+// ---------------------------------------------------------------------------
+//
+// A snapshot '<dir>/<n>.snap' holds the keys and raw values of one parsed input file,
+// laid out to be memory-mapped and probed in place:
+//   magic, header size, header (varints: source path, source size and mtime, creation
+//   time, key count, hash table bits, then the parse settings as a length-prefixed string),
+//   then, 8-byte aligned:
+//   uint64 record offsets  one per key, in key order: the sorted index for prefix ranges
+//   uint32 hash slots      open addressing over the display keys, holding key ordinal + 1
+//   records                varint key length, key, varint value length, value
+// An exact lookup touches one or two slots and one record; a prefix lookup is a binary
+// search over the offsets followed by a scan.
+
+constexpr char kSnapshotMagic[8] = {'C', 'M', 'P', 'S', 'N', 'P', '0', '1'};
+
+inline size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+// Writes a snapshot of `data` (keys sorted in `keys`) taken from the file `source` to `path`.
+// `settings` describes the options the file was parsed with (see snapshot_settings).
+bool write_snapshot(const std::string& path, const std::string& source, const std::string& settings,
+                    const InstanceDataMap& data, const KeyList& keys) {
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+    stat_file(source, source_size, source_mtime);
+    unsigned table_bits = 4;
+    while ((size_t(1) << table_bits) < 2 * keys.size()) ++table_bits;
+
+    std::string header;
+    put_varint(header, source.size());
+    header += source;
+    put_varint(header, source_size);
+    put_varint(header, static_cast<uint64_t>(source_mtime));
+    put_varint(header, static_cast<uint64_t>(std::time(nullptr)));
+    put_varint(header, keys.size());
+    put_varint(header, table_bits);
+    put_varint(header, settings.size());
+    header += settings;
+
+    size_t offsets_pos = align8(sizeof(kSnapshotMagic) + 4 + header.size());
+    size_t slots_pos = offsets_pos + 8 * keys.size();
+    size_t records_pos = slots_pos + 4 * (size_t(1) << table_bits);
+    // Record offsets come from the record sizes, so the records themselves are only encoded
+    // while they are written, a chunk at a time.
+    std::vector<uint64_t> offsets(keys.size());
+    std::vector<uint32_t> slots(size_t(1) << table_bits, 0);
+    const size_t mask = slots.size() - 1;
+    uint64_t offset = records_pos;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string_view key = keys[i].display();
+        std::string_view value = data.at(keys[i]).first.text();
+        offsets[i] = offset;
+        offset += varint_size(key.size()) + key.size() + varint_size(value.size()) + value.size();
+        size_t s = hash_bytes(key.data(), key.size()) & mask;
+        while (slots[s]) s = (s + 1) & mask;
+        slots[s] = static_cast<uint32_t>(i + 1);
+    }
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        uint32_t header_size = static_cast<uint32_t>(header.size());
+        const char zeros[8] = {};
+        out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+        out.write(reinterpret_cast<const char*>(&header_size), 4);
+        out.write(header.data(), header.size());
+        out.write(zeros, offsets_pos - (sizeof(kSnapshotMagic) + 4 + header.size()));
+        out.write(reinterpret_cast<const char*>(offsets.data()), 8 * offsets.size());
+        out.write(reinterpret_cast<const char*>(slots.data()), 4 * slots.size());
+        constexpr size_t kChunkBytes = 1u << 20;
+        std::string chunk;
+        chunk.reserve(kChunkBytes);
+        for (size_t i = 0; i < keys.size() && out; ++i) {
+            std::string_view key = keys[i].display();
+            std::string_view value = data.at(keys[i]).first.text();
+            put_varint(chunk, key.size());
+            chunk += key;
+            put_varint(chunk, value.size());
+            chunk += value;
+            if (chunk.size() >= kChunkBytes) {
+                out.write(chunk.data(), chunk.size());
+                chunk.clear();
+            }
+        }
+        out.write(chunk.data(), chunk.size());
+        if (!out) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// A memory-mapped snapshot.
+class Snapshot {
+public:
+    // Maps and validates the snapshot at `path`.
+    bool open(const std::string& path) {
+        file_ = std::make_unique<MappedFile>(path);
+        const char* base = file_->data();
+        size_t size = file_->size();
+        if (!base || size < sizeof(kSnapshotMagic) + 4 || std::memcmp(base, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) return false;
+        ::madvise(const_cast<char*>(base), size, MADV_RANDOM);
+        uint32_t header_size;
+        std::memcpy(&header_size, base + sizeof(kSnapshotMagic), 4);
+        const char* p = base + sizeof(kSnapshotMagic) + 4;
+        const char* end = p + std::min<size_t>(header_size, size - (sizeof(kSnapshotMagic) + 4));
+        uint64_t mtime, created, table_bits;
+        if (!get_bytes(p, end, source_) || !get_varint(p, end, source_size_) || !get_varint(p, end, mtime) ||
+            !get_varint(p, end, created) || !get_varint(p, end, count_) || !get_varint(p, end, table_bits) || table_bits > 40) return false;
+        // Snapshots written before the settings were recorded end here; they match no settings.
+        if (p < end && !get_bytes(p, end, settings_)) return false;
+        source_mtime_ = static_cast<int64_t>(mtime);
+        created_ = static_cast<int64_t>(created);
+        mask_ = (uint64_t(1) << table_bits) - 1;
+        size_t offsets_pos = align8(sizeof(kSnapshotMagic) + 4 + header_size);
+        offsets_ = base + offsets_pos;
+        slots_ = offsets_ + 8 * count_;
+        return offsets_pos + 8 * count_ + 4 * (mask_ + 1) <= size;
+    }
+
+    const std::string& source() const { return source_; }
+    const std::string& settings() const { return settings_; }
+    uint64_t source_size() const { return source_size_; }
+    int64_t source_mtime() const { return source_mtime_; }
+    int64_t created() const { return created_; }
+    uint64_t size() const { return count_; }
+
+    // Finds the value of `key` through the hash slots.
+    bool find(std::string_view key, std::string_view& value) const {
+        for (uint64_t s = hash_bytes(key.data(), key.size()) & mask_;; s = (s + 1) & mask_) {
+            uint32_t slot;
+            std::memcpy(&slot, slots_ + 4 * s, 4);
+            if (!slot) return false;
+            std::string_view k;
+            if (record(slot - 1, k, value) && k == key) return true;
+        }
+    }
+
+    // Calls fn(key, value) for every key starting with `prefix`, in key order, found by a
+    // binary search over the sorted offsets.
+    template <typename Fn>
+    void for_prefix(std::string_view prefix, Fn&& fn) const {
+        std::string_view k, v;
+        uint64_t lo = 0, hi = count_;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (record(mid, k, v) && k < prefix) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < count_ && record(lo, k, v) && k.substr(0, prefix.size()) == prefix; ++lo) fn(k, v);
+    }
+
+private:
+    // The key and value of the i-th record in key order.
+    bool record(uint64_t i, std::string_view& key, std::string_view& value) const {
+        uint64_t offset, klen, vlen;
+        std::memcpy(&offset, offsets_ + 8 * i, 8);
+        const char* end = file_->data() + file_->size();
+        if (offset >= file_->size()) return false;
+        const char* p = file_->data() + offset;
+        if (!get_varint(p, end, klen) || klen > static_cast<uint64_t>(end - p)) return false;
+        key = std::string_view(p, klen);
+        p += klen;
+        if (!get_varint(p, end, vlen) || vlen > static_cast<uint64_t>(end - p)) return false;
+        value = std::string_view(p, vlen);
+        return true;
+    }
+
+    std::unique_ptr<MappedFile> file_;
+    std::string source_, settings_;
+    uint64_t source_size_ = 0, count_ = 0, mask_ = 0;
+    int64_t source_mtime_ = 0, created_ = 0;
+    const char* offsets_ = nullptr;
+    const char* slots_ = nullptr;
+};
+
+// The numbered snapshots in `dir`, in number order. Unreadable files are skipped with a warning.
+std::vector<std::pair<uint64_t, std::unique_ptr<Snapshot>>> open_snapshots(const std::string& dir) {
+    std::vector<std::pair<uint64_t, std::unique_ptr<Snapshot>>> snapshots;
+    DIR* d = ::opendir(dir.c_str());
+    if (!d) return snapshots;
+    while (dirent* entry = ::readdir(d)) {
+        std::string name = entry->d_name;
+        char* end;
+        uint64_t number = std::strtoull(name.c_str(), &end, 10);
+        if (end == name.c_str() || std::strcmp(end, ".snap") != 0) continue;
+        auto snap = std::make_unique<Snapshot>();
+        if (snap->open(dir + "/" + name)) {
+            snapshots.emplace_back(number, std::move(snap));
+        } else {
+            std::cerr << "Warning: Skipping unreadable snapshot " << dir << "/" << name << std::endl;
+        }
+    }
+    ::closedir(d);
+    std::sort(snapshots.begin(), snapshots.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return snapshots;
+}
+
+// The options that decide what a parse of file `side` (1 or 2) holds: key and value columns,
+// value expression, row filter, key normalization and delimiter. Two snapshots of the same
+// file are interchangeable only when these match.
+std::string snapshot_settings(std::unordered_map<std::string, std::string>& args, int side) {
+    std::string settings;
+    auto add = [&](const std::string& name) {
+        auto it = args.find(name);
+        if (it == args.end()) return;
+        put_varint(settings, name.size());
+        settings += name;
+        put_varint(settings, it->second.size());
+        settings += it->second;
+    };
+    const std::string n = std::to_string(side);
+    for (const char* name : {"--instcol", "--valcol", "--valexpr", "--where", "--normalize"}) add(name + n);
+    add("--normalize");
+    add("--delim");
+    return settings;
+}
+
+// Snapshots both parsed files into `dir` (created if missing), each on its own thread.
+// A file whose snapshot is already there (same path, size, mtime and parse settings) is not
+// written again. Returns the number of snapshots written, or -1 with a message in `error`.
+int snapshot_files(const std::string& dir, const std::string (&sources)[2], const std::string (&settings)[2],
+                   const InstanceDataMap* (&data)[2], const KeyList* (&keys)[2], std::string& error) {
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "Cannot create snapshot directory '" + dir + "'";
+        return -1;
+    }
+    int lock = ::open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock < 0 || ::flock(lock, LOCK_EX) != 0) {
+        if (lock >= 0) ::close(lock);
+        error = "Cannot lock snapshot directory '" + dir + "'";
+        return -1;
+    }
+    struct Unlock {
+        int fd;
+        ~Unlock() { ::close(fd); }
+    } unlock{lock};
+
+    uint64_t next = 1;
+    auto snapshots = open_snapshots(dir);
+    for (const auto& s : snapshots) next = std::max(next, s.first + 1);
+    std::vector<std::future<bool>> writes;
+    for (int i = 0; i < 2; ++i) {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        stat_file(sources[i], size, mtime);
+        bool current = std::any_of(snapshots.begin(), snapshots.end(), [&](const auto& s) {
+            return s.second->source() == sources[i] && s.second->source_size() == size && s.second->source_mtime() == mtime &&
+                   s.second->settings() == settings[i];
+        });
+        if (current || (i == 1 && sources[1] == sources[0] && settings[1] == settings[0])) continue;
+        std::string path = dir + "/" + std::to_string(next++) + ".snap";
+        writes.push_back(std::async(std::launch::async,
+                                    [&, i, path] { return write_snapshot(path, sources[i], settings[i], *data[i], *keys[i]); }));
+    }
+    int written = 0;
+    for (auto& w : writes) {
+        if (!w.get()) {
+            error = "Cannot write a snapshot in '" + dir + "'";
+            return -1;
+        }
+        ++written;
+    }
+    return written;
+}
+
+// Looks keys up in every snapshot of a directory: exact keys through the hash index,
+// prefixes through the sorted index. Batches of keys are split across threads.
+int run_lookup(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--dir") || !(args.count("--key") || args.count("--keys_file") || args.count("--prefix"))) {
+        std::cerr << "❌ Error: lookup requires --dir <path> and --key <k1,k2,...>, --keys_file <path> or --prefix <p>." << std::endl;
+        return 1;
+    }
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        if (args.count("--threads")) workers = std::max(1ul, std::stoul(args["--threads"]));
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --threads. Please provide a number." << std::endl;
+        return 1;
+    }
+    auto t_start = std::chrono::high_resolution_clock::now();
+    auto snapshots = open_snapshots(args["--dir"]);
+    if (snapshots.empty()) {
+        std::cerr << "❌ Error: No snapshots in '" << args["--dir"] << "'. Run a comparison with --snapshot first." << std::endl;
+        return 1;
+    }
+    std::vector<std::string> keys;
+    if (args.count("--key")) keys = split(args["--key"], ',');
+    if (args.count("--keys_file")) {
+        std::ifstream in(args["--keys_file"]);
+        if (!in) {
+            std::cerr << "❌ Error: Cannot open file '" << args["--keys_file"] << "'" << std::endl;
+            return 1;
+        }
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) keys.push_back(std::move(line));
+        }
+    }
+
+    // Each slice of keys writes its rows to its own buffer; buffers are printed in order.
+    auto row = [&](std::string& out, size_t s, std::string_view key, std::string_view value) {
+        out += std::to_string(snapshots[s].first);
+        out += ',';
+        out += snapshots[s].second->source();
+        out += ',';
+        out += key;
+        out += ',';
+        out += value;
+        out += '\n';
+    };
+    std::vector<std::string> parts(std::max(1u, workers));
+    size_t step = std::max<size_t>(1, (keys.size() + parts.size() - 1) / parts.size());
+    std::atomic<size_t> found{0};
+    parallel_slices(keys.size(), static_cast<unsigned>(parts.size()), [&](size_t lo, size_t hi) {
+        std::string& out = parts[lo / step];
+        size_t n = 0;
+        std::string_view value;
+        for (size_t i = lo; i < hi; ++i) {
+            for (size_t s = 0; s < snapshots.size(); ++s) {
+                if (snapshots[s].second->find(keys[i], value)) {
+                    row(out, s, keys[i], value);
+                    ++n;
+                }
+            }
+        }
+        found += n;
+    });
+    std::string prefixed;
+    if (args.count("--prefix")) {
+        for (size_t s = 0; s < snapshots.size(); ++s) {
+            snapshots[s].second->for_prefix(args["--prefix"], [&](std::string_view key, std::string_view value) {
+                row(prefixed, s, key, value);
+                ++found;
+            });
+        }
+    }
+    std::cout << "Snapshot,Source,Key,Value\n";
+    for (const auto& part : parts) std::cout << part;
+    std::cout << prefixed;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+    std::cerr << found << " value(s) for " << keys.size() << " key(s)" << (args.count("--prefix") ? " and 1 prefix" : "")
+              << " from " << snapshots.size() << " snapshot(s) in " << ms << " ms." << std::endl;
+    return found ? 0 : 2;
+}
+
+// ---------------------------------------------------------------------------
+// Sampled comparison (--sample)
+// ---------------------------------------------------------------------------
+//
+// --sample p compares a stable fraction p of the keys and scales the counts up. A key is
+// sampled if its hash is at most p * 2^64, so both files (and reruns) sample the same
+// keys; other lines are dropped right after their key is hashed. When both files have a
+// valid sidecar index (--index) showing them sorted by key, whole index blocks of file1
+// are sampled instead, each with probability p, and only those blocks and the blocks of
+// file2 that can hold the same key ranges are read. Key samples give Horvitz-Thompson
+// estimates; block samples give ratio estimates against the key lines the index counts
+// in each block. Both come with normal 95% intervals.
+
+// The blocks a sparse sample reads from two sorted, indexed files.
+struct SparseSample {
+    KeyRanges keys;                     // key ranges of the sampled file1 blocks
+    std::vector<std::string> starts;    // first key of each sampled block's range, ascending
+    std::vector<double> lines;          // key lines of each sampled block
+    double total_lines = 0;             // key lines of all file1 blocks
+    std::vector<std::pair<long long, long long>> bytes1, bytes2;
+    size_t blocks = 0;                  // file1 blocks holding keys
+};
+
+// Plans a sparse sample of blocks with hashes at most `threshold`. Returns false unless
+// both indexes list their keys in sorted order.
+bool plan_sparse_sample(const LineIndex& index1, const LineIndex& index2, uint64_t threshold, SparseSample& sample) {
+    // The blocks holding keys; the files are sorted if their key ranges don't overlap.
+    auto key_blocks = [](const LineIndex& index, std::vector<size_t>& out) {
+        for (size_t i = 0; i < index.blocks.size(); ++i) {
+            if (!index.blocks[i].keys) continue;
+            if (!out.empty() && index.blocks[i].key_min < index.blocks[out.back()].key_max) return false;
+            out.push_back(i);
+        }
+        return true;
+    };
+    std::vector<size_t> blocks1, blocks2;
+    if (!key_blocks(index1, blocks1) || !key_blocks(index2, blocks2)) return false;
+    sample.blocks = blocks1.size();
+    for (size_t b : blocks1) sample.total_lines += index1.blocks[b].keys;
+
+    // Bytes of a block up to the next block holding keys; overlapping blocks are read once.
+    auto add_bytes = [](std::vector<std::pair<long long, long long>>& out, const LineIndex& index,
+                        const std::vector<size_t>& blocks, size_t k) {
+        long long lo = static_cast<long long>(index.blocks[blocks[k]].offset);
+        long long hi = static_cast<long long>(k + 1 < blocks.size() ? index.blocks[blocks[k + 1]].offset : index.file_size);
+        if (out.empty() || out.back().second <= lo) out.emplace_back(lo, hi);
+    };
+    // Each file1 block stands for the keys from its first key up to the next block's.
+    for (size_t u = 0; u < blocks1.size(); ++u) {
+        const std::string& first = index1.blocks[blocks1[u]].key_min;
+        if (hash_bytes(first.data(), first.size()) > threshold) continue;
+        std::string lo = u ? first : std::string();
+        std::string hi = u + 1 < blocks1.size() ? index1.blocks[blocks1[u + 1]].key_min : std::string();
+        auto& ranges = sample.keys.ranges;
+        if (!ranges.empty() && !ranges.back().second.empty() && ranges.back().second == lo) {
+            ranges.back().second = hi;
+        } else {
+            ranges.emplace_back(lo, hi);
+        }
+        sample.starts.push_back(lo);
+        sample.lines.push_back(index1.blocks[blocks1[u]].keys);
+        add_bytes(sample.bytes1, index1, blocks1, u);
+        size_t k = std::partition_point(blocks2.begin(), blocks2.end(), [&](size_t b) {
+            return index2.blocks[b].key_max < lo;
+        }) - blocks2.begin();
+        for (; k < blocks2.size() && (hi.empty() || index2.blocks[blocks2[k]].key_min < hi); ++k) {
+            add_bytes(sample.bytes2, index2, blocks2, k);
+        }
+    }
+    return true;
+}
+
+// A total estimated from a sample, with its 95% confidence interval.
+struct SampleEstimate {
+    double value = 0;
+    double half_width = 0;
+};
+
+// Estimates the total behind sampled `keys`, each key (or, with `sparse`, each block)
+// sampled with probability p. A block's keys are those in its key range; the ratio of
+// the keys to the blocks' key lines is scaled to the key lines of the whole file.
+SampleEstimate estimate_keys(const KeyList& keys, const SparseSample* sparse, double p) {
+    if (!sparse) {
+        double n = static_cast<double>(keys.size());
+        return {n / p, 1.96 * std::sqrt((1 - p) * n) / p};
+    }
+    const auto& starts = sparse->starts;
+    std::vector<double> counts(starts.size(), 0);
+    for (const auto& key : keys) {
+        size_t unit = std::upper_bound(starts.begin(), starts.end(), key.display(), [](std::string_view k, const std::string& s) {
+            return k < s;
+        }) - starts.begin();
+        if (unit) ++counts[unit - 1];
+    }
+    double sum = 0, lines = 0;
+    for (size_t u = 0; u < counts.size(); ++u) {
+        sum += counts[u];
+        lines += sparse->lines[u];
+    }
+    if (lines == 0) return {};
+    double ratio = sum / lines, residuals = 0;
+    for (size_t u = 0; u < counts.size(); ++u) {
+        double r = counts[u] - ratio * sparse->lines[u];
+        residuals += r * r;
+    }
+    return {ratio * sparse->total_lines, 1.96 * std::sqrt((1 - p) * residuals) / p};
+}
+
+// Absolute deviations in percent of the matched pairs with numeric values, ascending.
+std::vector<double> sampled_deviations(const InstanceDataMap& data1, const InstanceDataMap& data2, const KeyList& matched) {
+    std::vector<double> deviations;
+    for (const auto& key : matched) {
+        double val1, val2;
+        if (!numeric_value(data1.at(key).second, val1) || !numeric_value(data2.at(key).second, val2) || val2 == 0) continue;
+        double d = std::fabs((val1 - val2) / val2 * 100);
+        if (std::isfinite(d)) deviations.push_back(d);
+    }
+    std::sort(deviations.begin(), deviations.end());
+    return deviations;
+}
+
+// Prints the estimated counts of a sampled run and the quantiles of its deviations. A
+// quantile's interval is the distribution-free one between two order statistics, which
+// treats the sampled pairs as independent (it is optimistic for block samples).
+void print_sample_estimates(
+    const std::string& f1_basename, const std::string& f2_basename, double p, const SparseSample* sparse,
+    const KeyList& matched, const KeyList& missing_in_file2, const KeyList& missing_in_file1,
+    const std::vector<double>& deviations
+) {
+    SampleEstimate est_matched = estimate_keys(matched, sparse, p);
+    SampleEstimate est_miss2 = estimate_keys(missing_in_file2, sparse, p);
+    SampleEstimate est_miss1 = estimate_keys(missing_in_file1, sparse, p);
+    // The instances of a file are the matched keys plus its own missing ones, estimated
+    // together so the interval accounts for both.
+    KeyList all1(matched), all2(matched);
+    all1.insert(all1.end(), missing_in_file2.begin(), missing_in_file2.end());
+    all2.insert(all2.end(), missing_in_file1.begin(), missing_in_file1.end());
+    SampleEstimate est_inst1 = estimate_keys(all1, sparse, p);
+    SampleEstimate est_inst2 = estimate_keys(all2, sparse, p);
+
+    auto line = [](const std::string& label, const SampleEstimate& e) {
+        std::cout << "  " << label << ": ~" << std::llround(e.value) << " (95% CI "
+                  << std::llround(std::max(0.0, e.value - e.half_width)) << " - " << std::llround(e.value + e.half_width) << ")\n";
+    };
+    std::cout << "\nSampled " << p * 100 << "% of the keys";
+    if (sparse) {
+        std::cout << " by index block (" << sparse->starts.size() << " of " << sparse->blocks << " blocks read)";
+    } else {
+        std::cout << " by key hash";
+    }
+    std::cout << "; estimates for the full files:\n";
+    line("Instances in " + f1_basename, est_inst1);
+    line("Instances in " + f2_basename, est_inst2);
+    line("Matched Instances", est_matched);
+    line("Missing from " + f2_basename, est_miss2);
+    line("Missing from " + f1_basename, est_miss1);
+
+    const size_t n = deviations.size();
+    if (n == 0) return;
+    std::cout << "  |Deviation| quantiles over " << n << " sampled numeric pairs:\n";
+    for (double q : {0.5, 0.9, 0.99}) {
+        double center = n * q, spread = 1.96 * std::sqrt(n * q * (1 - q));
+        auto rank = [&](double r) { return static_cast<size_t>(std::clamp(r, 0.0, static_cast<double>(n - 1))); };
+        std::cout << "    p" << q * 100 << ": " << deviations[rank(std::ceil(center) - 1)] << "% (95% CI "
+                  << deviations[rank(std::floor(center - spread) - 1)] << "% - " << deviations[rank(std::ceil(center + spread) - 1)] << "%)\n";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Key presence only (--presence_only)
+// ---------------------------------------------------------------------------
+//
+// When only the matched/missing counts and lists are wanted, each instance line is reduced
+// to a 16-byte KeyPrint: the hash of its key and the file offset of the line. No key text,
+// value or hash table is kept. Workers bucket the prints by the top bits of the hash, so
+// the buckets of both files are sorted and merge-joined independently, in parallel. Equal
+// hashes are confirmed against the key bytes in the memory-mapped files, which resolves
+// both hash collisions and keys repeated within a file, and key text is only read back for
+// the missing keys that are written out.
+
+struct KeyPrint {
+    uint64_t hash;
+    uint64_t offset;  // of the line in its file
+};
+using KeyPrints = std::pmr::vector<KeyPrint>;
+
+inline bool key_print_less(const KeyPrint& a, const KeyPrint& b) {
+    return a.hash != b.hash ? a.hash < b.hash : a.offset < b.offset;
+}
+
+// Reads the (normalized) key fields of instance lines with the rules of LineParser.
+class KeyFieldReader {
+public:
+    KeyFieldReader(const std::vector<int>& inst_cols, int value_col, const ParseOptions& opts)
+        : inst_cols_(&inst_cols), opts_(&opts), fields_(inst_cols.size()) {
+        int max_col = value_col;
+        for (int col : inst_cols) max_col = std::max(max_col, col);
+        parts_.resize(max_col + 1);
+    }
+
+    // Reads the key of the line [begin, end); `limit` bounds the readable memory. Returns
+    // false if it is not an instance line.
+    bool read(const char* begin, const char* end, const char* limit) {
+        if (begin == end || *begin == '#' || *begin == '\r') return false;
+        size_t n = split_fields_as(opts_->delim, begin, end, limit, parts_.data(), parts_.size());
+        if (n < parts_.size() || METADATA_KEYWORD_VIEWS.count(parts_[0])) return false;
+        size_t needed = 0;
+        for (size_t i = 0; i < fields_.size(); ++i) {
+            fields_[i] = parts_[(*inst_cols_)[i]];
+            needed += fields_[i].size();
+        }
+        if (opts_->normalizer) {
+            if (norm_buf_.size() < needed) norm_buf_.resize(needed);
+            char* out = norm_buf_.data();
+            for (auto& field : fields_) out += opts_->normalizer->apply(field, out);
+        }
+        return true;
+    }
+
+    // Reads the key of the line starting at `offset` of a mapped file.
+    bool read_at(const MappedFile& file, uint64_t offset) {
+        const char* begin = file.data() + offset;
+        const char* limit = file.data() + file.size();
+        const char* nl = static_cast<const char*>(std::memchr(begin, '\n', limit - begin));
+        return read(begin, nl ? nl : limit, limit);
+    }
+
+    // A probe over the fields last read, valid until the next read.
+    InstanceKey probe() const { return InstanceKey(fields_.data(), static_cast<uint32_t>(fields_.size())); }
+
+    // Appends the fields last read in an unambiguous encoding, for sorting and comparing.
+    void encode(std::string& out) const {
+        out.clear();
+        for (const auto& field : fields_) {
+            put_varint(out, field.size());
+            out += field;
+        }
+    }
+
+private:
+    const std::vector<int>* inst_cols_;
+    const ParseOptions* opts_;
+    std::vector<std::string_view> parts_;
+    std::vector<std::string_view> fields_;
+    std::vector<char> norm_buf_;
+};
+
+// Fingerprints the instance lines of a file in parallel. `buckets[c][b]` receives the
+// prints of chunk c whose hash has the top `bits` bits b, in file order; `lines` counts
+// the instance lines.
+void fingerprint_file(const std::string& file_path, const std::vector<int>& inst_cols, int value_col,
+                      const ParseOptions& opts, unsigned bits, Region& region,
+                      std::vector<std::vector<KeyPrints>>& buckets, uint64_t& lines) {
+    unsigned num_workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "\nFingerprinting keys of " << file_path << " with " << num_workers << " workers"
+              << (opts.oneshot ? " (one-shot: parsed ranges leave the page cache)" : "") << "..." << std::endl;
+    auto chunks = find_chunk_boundaries(file_path, num_workers);
+    buckets.clear();
+    buckets.resize(chunks.size());
+    std::vector<TrackedResource*> memory;
+    for (size_t c = 0; c < chunks.size(); ++c) memory.push_back(&region.tracked(region.new_arena(1u << 20), MemCategory::KeyLists));
+
+    std::atomic<uint64_t> total{0};
+    std::atomic<bool> complete{true};
+    std::vector<std::future<void>> futures;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        futures.push_back(std::async(std::launch::async, [&, c] {
+            auto& mine = buckets[c];
+            mine.reserve(size_t(1) << bits);
+            for (size_t b = 0; b < (size_t(1) << bits); ++b) mine.emplace_back(memory[c]);
+            KeyFieldReader reader(inst_cols, value_col, opts);
+            uint64_t n = 0;
+            bool read = for_each_line(file_path, chunks[c].first, chunks[c].second, opts.oneshot,
+                          [&](const char* begin, const char* end, const char* limit, uint64_t line_start) {
+                if (!reader.read(begin, end, limit)) return;
+                uint64_t h = reader.probe().hash();
+                mine[h >> (64 - bits)].push_back({h, line_start});
+                ++n;
+            });
+            if (!read) complete = false;
+            total += n;
+        }));
+    }
+    for (auto& fut : futures) fut.get();
+    lines = total;
+    if (!complete) {
+        std::cerr << "Warning: Could not read all of " << file_path << " (read error or the file shrank); "
+                  << "its keys and counts are incomplete." << std::endl;
+    }
+}
+
+// Outcome of joining the prints of two files.
+struct PresenceJoin {
+    uint64_t matched = 0;
+    uint64_t collisions = 0;  // distinct keys sharing a hash with another key
+    uint64_t repeats = 0;     // lines repeating a key of the same file
+    std::vector<uint64_t> missing_in_file2;  // line offsets in file1
+    std::vector<uint64_t> missing_in_file1;  // line offsets in file2
+};
+
+// Sorts and merge-joins each bucket of the two files on `workers` threads. A hash seen once
+// on each side is a match if the two keys' bytes agree; any other group of equal hashes is
+// sorted out by the keys' bytes.
+PresenceJoin join_key_prints(
+    const std::vector<std::vector<KeyPrints>>& buckets1, const std::vector<std::vector<KeyPrints>>& buckets2,
+    unsigned bits, const MappedFile& map1, const MappedFile& map2,
+    const KeyFieldReader& proto1, const KeyFieldReader& proto2, unsigned workers
+) {
+    const size_t nbuckets = size_t(1) << bits;
+    std::vector<PresenceJoin> parts(std::max(1u, workers));
+    size_t step = std::max<size_t>(1, (nbuckets + parts.size() - 1) / parts.size());
+    parallel_slices(nbuckets, static_cast<unsigned>(parts.size()), [&](size_t lo, size_t hi) {
+        PresenceJoin& out = parts[lo / step];
+        KeyFieldReader reader1 = proto1, reader2 = proto2;
+        std::vector<KeyPrint> a, b;
+        struct Entry {
+            std::string key;  // encoded key bytes
+            int side;         // 0 for file1, 1 for file2
+            uint64_t offset;
+        };
+        std::vector<Entry> group;
+        auto gather = [](const std::vector<std::vector<KeyPrints>>& buckets, size_t bucket, std::vector<KeyPrint>& v) {
+            v.clear();
+            for (const auto& chunk : buckets) v.insert(v.end(), chunk[bucket].begin(), chunk[bucket].end());
+            std::sort(v.begin(), v.end(), key_print_less);
+        };
+        for (size_t bucket = lo; bucket < hi; ++bucket) {
+            gather(buckets1, bucket, a);
+            gather(buckets2, bucket, b);
+            size_t i = 0, j = 0;
+            while (i < a.size() || j < b.size()) {
+                uint64_t h = j == b.size() || (i < a.size() && a[i].hash < b[j].hash) ? a[i].hash : b[j].hash;
+                size_t i2 = i, j2 = j;
+                while (i2 < a.size() && a[i2].hash == h) ++i2;
+                while (j2 < b.size() && b[j2].hash == h) ++j2;
+                if (i2 - i + j2 - j == 1) {
+                    if (i2 > i) out.missing_in_file2.push_back(a[i].offset);
+                    else out.missing_in_file1.push_back(b[j].offset);
+                } else if (i2 - i == 1 && j2 - j == 1) {
+                    if (reader1.read_at(map1, a[i].offset) && reader2.read_at(map2, b[j].offset) &&
+                        reader1.probe() == reader2.probe()) {
+                        ++out.matched;
+                    } else {
+                        out.collisions += 2;
+                        out.missing_in_file2.push_back(a[i].offset);
+                        out.missing_in_file1.push_back(b[j].offset);
+                    }
+                } else {
+                    // Group the lines by key; the first line of a key on each side stands for it.
+                    group.resize(i2 - i + j2 - j);
+                    size_t g = 0;
+                    for (size_t k = i; k < i2; ++k, ++g) {
+                        reader1.read_at(map1, a[k].offset);
+                        reader1.encode(group[g].key);
+                        group[g].side = 0;
+                        group[g].offset = a[k].offset;
+                    }
+                    for (size_t k = j; k < j2; ++k, ++g) {
+                        reader2.read_at(map2, b[k].offset);
+                        reader2.encode(group[g].key);
+                        group[g].side = 1;
+                        group[g].offset = b[k].offset;
+                    }
+                    std::sort(group.begin(), group.end(), [](const Entry& x, const Entry& y) {
+                        if (x.key != y.key) return x.key < y.key;
+                        return x.side != y.side ? x.side < y.side : x.offset < y.offset;
+                    });
+                    size_t distinct = 0;
+                    for (size_t k = 0; k < group.size();) {
+                        size_t end = k;
+                        while (end < group.size() && group[end].key == group[k].key) ++end;
+                        bool in1 = group[k].side == 0, in2 = group[end - 1].side == 1;
+                        if (in1 && in2) {
+                            ++out.matched;
+                        } else if (in1) {
+                            out.missing_in_file2.push_back(group[k].offset);
+                        } else {
+                            out.missing_in_file1.push_back(group[k].offset);
+                        }
+                        out.repeats += end - k - in1 - in2;
+                        ++distinct;
+                        k = end;
+                    }
+                    out.collisions += distinct > 1 ? distinct : 0;
+                }
+                i = i2;
+                j = j2;
+            }
+        }
+    });
+
+    PresenceJoin join;
+    for (auto& part : parts) {
+        join.matched += part.matched;
+        join.collisions += part.collisions;
+        join.repeats += part.repeats;
+        join.missing_in_file2.insert(join.missing_in_file2.end(), part.missing_in_file2.begin(), part.missing_in_file2.end());
+        join.missing_in_file1.insert(join.missing_in_file1.end(), part.missing_in_file1.begin(), part.missing_in_file1.end());
+    }
+    return join;
+}
+
+// Reads back the keys of the lines at `offsets` (visited in file order) into `keys`,
+// sorted for output.
+void keys_at_offsets(const MappedFile& file, std::vector<uint64_t>& offsets, KeyFieldReader reader,
+                     std::pmr::memory_resource& mr, KeyList& keys) {
+    std::sort(offsets.begin(), offsets.end());
+    keys.reserve(offsets.size());
+    for (uint64_t offset : offsets) {
+        if (reader.read_at(file, offset)) keys.push_back(InstanceKey::materialize(reader.probe(), mr));
+    }
+    std::sort(keys.begin(), keys.end(), key_display_less);
+}
+
+// The --presence_only counterpart of run_compare(): finds the matched and missing keys of
+// the two files from their key prints and writes missing_instances.txt.
+int run_presence_compare(
+    std::unordered_map<std::string, std::string>& args,
+    const std::vector<int>& instcol1, int valcol1, const std::vector<int>& instcol2, int valcol2,
+    const ParseOptions& opts1, const ParseOptions& opts2, MissingFormat missing_format, RunReport* report
+) {
+    auto t_start = std::chrono::high_resolution_clock::now();
+    if (missing_format == MissingFormat::Collapsed) {
+        std::cerr << "Warning: --missing_format collapsed needs the matched keys, which --presence_only doesn't keep; "
+                  << "writing the grouped format." << std::endl;
+        missing_format = MissingFormat::Grouped;
+    }
+    unsigned workers = opts1.workers ? opts1.workers : std::max(1u, std::thread::hardware_concurrency());
+    // About four buckets per worker keep the join balanced.
+    unsigned bits = 4;
+    while ((1u << bits) < 4 * workers && bits < 16) ++bits;
+
+    Region region;
+    Arena& arena = region.main();
+    std::vector<std::vector<KeyPrints>> buckets1, buckets2;
+    uint64_t lines1 = 0, lines2 = 0;
+    fingerprint_file(args["--file1"], instcol1, valcol1, opts1, bits, region, buckets1, lines1);
+    fingerprint_file(args["--file2"], instcol2, valcol2, opts2, bits, region, buckets2, lines2);
+    region.end_phase("parse");
+
+    std::cout << "\nComparing key prints..." << std::endl;
+    MappedFile map1(args["--file1"]), map2(args["--file2"]);
+    KeyFieldReader reader1(instcol1, valcol1, opts1), reader2(instcol2, valcol2, opts2);
+    PresenceJoin join = join_key_prints(buckets1, buckets2, bits, map1, map2, reader1, reader2, workers);
+    region.end_phase("compare");
+
+    std::cout << "Writing output files..." << std::endl;
+    TrackedResource& key_lists = region.tracked(arena, MemCategory::KeyLists);
+    auto& missing_in_file2 = arena.make<KeyList>(&key_lists);
+    auto& missing_in_file1 = arena.make<KeyList>(&key_lists);
+    TrackedResource& keys = region.tracked(arena, MemCategory::Keys);
+    keys_at_offsets(map1, join.missing_in_file2, reader1, keys, missing_in_file2);
+    keys_at_offsets(map2, join.missing_in_file1, reader2, keys, missing_in_file1);
+    std::string f1_basename = args["--file1"].substr(args["--file1"].find_last_of("/\\") + 1);
+    std::string f2_basename = args["--file2"].substr(args["--file2"].find_last_of("/\\") + 1);
+    write_missing_file(f1_basename, f2_basename, missing_in_file2, missing_in_file1, missing_format);
+    region.end_phase("output");
+
+    double elapsed_time_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+    size_t instances1 = join.matched + missing_in_file2.size(), instances2 = join.matched + missing_in_file1.size();
+    std::cout << "\n===================================\n";
+    std::cout << "✅ All tasks completed (key presence only; comparison.csv is not written).\n";
+    std::cout << "===================================\n";
+    std::cout << "Instances in " << f1_basename << ": " << instances1 << "\n";
+    std::cout << "Instances in " << f2_basename << ": " << instances2 << "\n";
+    std::cout << "Matched Instances: " << join.matched << "\n";
+    std::cout << "Missing from " << f2_basename << ": " << missing_in_file2.size() << "\n";
+    std::cout << "Missing from " << f1_basename << ": " << missing_in_file1.size() << "\n";
+    std::cout << "Key prints: " << lines1 + lines2 << " lines, "
+              << (lines1 + lines2) * sizeof(KeyPrint) / (1024.0 * 1024.0) << " MiB; " << join.repeats
+              << " repeated keys and " << join.collisions << " keys with colliding hashes resolved from the key bytes\n";
+    std::cout << "Arena memory reserved: " << region.bytes_reserved() / (1024.0 * 1024.0) << " MiB\n";
+    print_memory_breakdown(region.phases());
+    std::cout << "\nTotal execution time: " << elapsed_time_ms / 1000.0 << " seconds\n";
+
+    RunReport run;
+    run.file1 = args["--file1"];
+    run.file2 = args["--file2"];
+    run.instances1 = instances1;
+    run.instances2 = instances2;
+    run.matched = join.matched;
+    run.missing_in_file2 = missing_in_file2.size();
+    run.missing_in_file1 = missing_in_file1.size();
+    run.elapsed_seconds = elapsed_time_ms / 1000.0;
+    run.memory = region.phases();
+    if (args.count("--json_report") && !write_json_report(args["--json_report"], run)) {
+        std::cerr << "Warning: Could not write JSON report " << args["--json_report"] << std::endl;
+    }
+    if (report) *report = std::move(run);
+    return 0;
+}
+
+// Runs one comparison of --file1 and --file2 as configured by `args` and prints its summary.
+// With `report`, the run's results, phase times and memory breakdown are also stored there.
+int run_compare(std::unordered_map<std::string, std::string>& args, RunReport* report = nullptr) {
+    std::vector<int> instcol1, instcol2;
+    int valcol1, valcol2;
+    try {
+        std::stringstream ss1(args["--instcol1"]);
+        std::string segment;
+        while(std::getline(ss1, segment, ',')) instcol1.push_back(std::stoi(segment));
+
+        std::stringstream ss2(args["--instcol2"]);
+        while(std::getline(ss2, segment, ',')) instcol2.push_back(std::stoi(segment));
+
+        // A --valexpr takes the place of the value column.
+        valcol1 = args.count("--valexpr1") && !args.count("--valcol1") ? 0 : std::stoi(args["--valcol1"]);
+        valcol2 = args.count("--valexpr2") && !args.count("--valcol2") ? 0 : std::stoi(args["--valcol2"]);
+    } catch (const std::exception& e) {
+        std::cerr << "❌ Error: Invalid column arguments. Please provide comma-separated integers." << std::endl;
+        return 1;
+    }
+    
+    bool fast_exit = args.count("--fast_exit") > 0;
+    ParseOptions parse_opts;
+    parse_opts.use_index = args.count("--index") > 0;
+    parse_opts.lazy_raw = args.count("--lazy_raw") > 0;
+    bool lazy_raw_mmap = parse_opts.lazy_raw && args["--lazy_raw"] == "mmap";
+    if (args["--delim"] == "comma" || args["--delim"] == ",") {
+        parse_opts.delim = Delimiter::Comma;
+    } else if (args["--delim"] == "tab") {
+        parse_opts.delim = Delimiter::Tab;
+    }
+    if (args["--comparison_type"] == "string") {
+        parse_opts.mode = ValueMode::String;
+    } else if (args["--comparison_type"] == "decimal") {
+        parse_opts.mode = ValueMode::Decimal;
+    } else if (parse_opts.lazy_raw) {
+        parse_opts.mode = ValueMode::Raw;
+    }
+    parse_opts.units = args.count("--units") > 0;
+    ValueExpr expr1, expr2;
+    bool use_expr1 = args.count("--valexpr1") > 0, use_expr2 = args.count("--valexpr2") > 0;
+    if (use_expr1 || use_expr2) {
+        if (parse_opts.mode != ValueMode::Numeric || args.count("--dict_values")) {
+            std::cerr << "❌ Error: --valexpr1/--valexpr2 derive numbers; they can't be combined with --comparison_type "
+                      << "string or decimal, --lazy_raw or --dict_values." << std::endl;
+            return 1;
+        }
+        std::string error;
+        if (use_expr1 && !expr1.compile(args["--valexpr1"], read_header_constants(args["--file1"], parse_opts.delim), false, error)) {
+            std::cerr << "❌ Error: --valexpr1 " << error << std::endl;
+            return 1;
+        }
+        if (use_expr2 && !expr2.compile(args["--valexpr2"], read_header_constants(args["--file2"], parse_opts.delim), false, error)) {
+            std::cerr << "❌ Error: --valexpr2 " << error << std::endl;
+            return 1;
+        }
+        if (use_expr1) valcol1 = expr1.max_column();
+        if (use_expr2) valcol2 = expr2.max_column();
+    }
+    ValueExpr where1, where2;
+    bool use_where1 = args.count("--where1") > 0, use_where2 = args.count("--where2") > 0;
+    if (use_where1 || use_where2) {
+        std::string error;
+        if (use_where1 && !where1.compile(args["--where1"], read_header_constants(args["--file1"], parse_opts.delim), true, error)) {
+            std::cerr << "❌ Error: --where1 " << error << std::endl;
+            return 1;
+        }
+        if (use_where2 && !where2.compile(args["--where2"], read_header_constants(args["--file2"], parse_opts.delim), true, error)) {
+            std::cerr << "❌ Error: --where2 " << error << std::endl;
+            return 1;
+        }
+    }
+    bool semijoin = args.count("--semijoin") > 0;
+    if (semijoin && args.count("--snapshot")) {
+        std::cerr << "❌ Error: --semijoin skips the values of rows it rules out; it can't be combined with --snapshot." << std::endl;
+        return 1;
+    }
+    bool follow1 = args.count("--follow1") > 0;
+    bool follow2 = args.count("--follow2") > 0;
+    FollowOptions follow_opts;
+    if (args.count("--trailer")) follow_opts.trailer = args["--trailer"];
+    try {
+        if (args.count("--index_stride")) parse_opts.index_stride = std::stoull(args["--index_stride"]);
+        if (args.count("--follow_timeout")) follow_opts.idle_timeout = std::stod(args["--follow_timeout"]);
+        if (args.count("--threads")) parse_opts.workers = static_cast<unsigned>(std::stoul(args["--threads"]));
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --index_stride, --follow_timeout or --threads. Please provide a number." << std::endl;
+        return 1;
+    }
+    double nearest_dist = -1;
+    LocationColumns loc1, loc2;
+    if (args.count("--nearest")) {
+        try {
+            nearest_dist = std::stod(args["--nearest"]);
+            auto xy1 = split(args["--xycol1"], ','), xy2 = split(args["--xycol2"], ',');
+            if (!(nearest_dist >= 0) || xy1.size() != 2 || xy2.size() != 2) throw std::invalid_argument("--nearest");
+            loc1.x = std::stoi(xy1[0]);
+            loc1.y = std::stoi(xy1[1]);
+            loc2.x = std::stoi(xy2[0]);
+            loc2.y = std::stoi(xy2[1]);
+            if (args.count("--cellcol1") != args.count("--cellcol2")) throw std::invalid_argument("--cellcol");
+            if (args.count("--cellcol1")) {
+                loc1.cell = std::stoi(args["--cellcol1"]);
+                loc2.cell = std::stoi(args["--cellcol2"]);
+            }
+            if (std::min({loc1.x, loc1.y, loc2.x, loc2.y}) < 0) throw std::invalid_argument("--xycol");
+        } catch (const std::exception&) {
+            std::cerr << "❌ Error: --nearest <max_dist> needs --xycol1 <x,y> and --xycol2 <x,y> "
+                      << "(and --cellcol1/--cellcol2 together, if given)." << std::endl;
+            return 1;
+        }
+    }
+    // --normalize rules apply to both files' keys; --normalize1/--normalize2 add rules for one.
+    KeyNormalizer norm1, norm2;
+    bool normalize1 = args.count("--normalize") || args.count("--normalize1");
+    bool normalize2 = args.count("--normalize") || args.count("--normalize2");
+    if ((args.count("--normalize") && !(norm1.parse(args["--normalize"]) && norm2.parse(args["--normalize"]))) ||
+        (args.count("--normalize1") && !norm1.parse(args["--normalize1"])) ||
+        (args.count("--normalize2") && !norm2.parse(args["--normalize2"]))) {
+        std::cerr << "❌ Error: Invalid --normalize rule. Use strip_prefix=<p>, unescape, divider=<a><b> or fold_case." << std::endl;
+        return 1;
+    }
+    std::unique_ptr<ToleranceSpec> tolerances;
+    if (args.count("--tolerances")) {
+        tolerances = std::make_unique<ToleranceSpec>();
+        std::string error;
+        if (!tolerances->load(args["--tolerances"], error)) {
+            std::cerr << "❌ Error: " << error << std::endl;
+            return 1;
+        }
+    }
+    MissingFormat missing_format = MissingFormat::Full;
+    if (args.count("--missing_format")) {
+        const std::string& format = args["--missing_format"];
+        if (format == "grouped") {
+            missing_format = MissingFormat::Grouped;
+        } else if (format == "collapsed") {
+            missing_format = MissingFormat::Collapsed;
+        } else if (format != "full") {
+            std::cerr << "❌ Error: --missing_format must be full, grouped or collapsed." << std::endl;
+            return 1;
+        }
+    }
+    long suggest_edits = -1;
+    size_t qgram = 3;
+    if (args.count("--suggest")) {
+        try {
+            suggest_edits = std::stol(args["--suggest"]);
+            if (args.count("--qgram")) qgram = std::stoul(args["--qgram"]);
+        } catch (const std::exception&) {
+            suggest_edits = -1;
+        }
+        if (suggest_edits < 0 || qgram < 1 || qgram > 7) {
+            std::cerr << "❌ Error: --suggest needs a maximum edit distance >= 0 (and --qgram between 1 and 7)." << std::endl;
+            return 1;
+        }
+    }
+    double sample = 1;
+    if (args.count("--sample")) {
+        try {
+            sample = std::stod(args["--sample"]);
+        } catch (const std::exception&) {
+            sample = 0;
+        }
+        if (!(sample > 0 && sample <= 1)) {
+            std::cerr << "❌ Error: --sample needs the fraction of keys to compare, greater than 0 and at most 1." << std::endl;
+            return 1;
+        }
+        if (args.count("--history") || args.count("--snapshot")) {
+            std::cerr << "❌ Error: --sample compares only part of the keys; it can't be combined with --history or --snapshot." << std::endl;
+            return 1;
+        }
+        parse_opts.sample_below = sample < 1 ? static_cast<uint64_t>(std::ldexp(sample, 64)) : UINT64_MAX;
+    }
+    if (args.count("--presence_only")) {
+        for (const char* opt : {"--tolerances", "--nearest", "--suggest", "--history", "--snapshot", "--follow1", "--follow2",
+                                "--semijoin", "--sample", "--where1", "--where2", "--valexpr1", "--valexpr2", "--dict_values",
+                                "--lazy_raw", "--units"}) {
+            if (args.count(opt)) {
+                std::cerr << "❌ Error: --presence_only reads no values and can't be combined with " << opt << "." << std::endl;
+                return 1;
+            }
+        }
+        // Matching hashes are confirmed against the key bytes after the parse, which needs the
+        // pages that one-shot reading drops.
+        for (const char* opt : {"--oneshot1", "--oneshot2"}) {
+            if (args.count(opt)) {
+                std::cerr << "❌ Error: --presence_only reads keys back after the parse and can't be combined with " << opt << "."
+                          << std::endl;
+                return 1;
+            }
+        }
+        ParseOptions opts1 = parse_opts, opts2 = parse_opts;
+        if (normalize1) opts1.normalizer = &norm1;
+        if (normalize2) opts2.normalizer = &norm2;
+        return run_presence_compare(args, instcol1, valcol1, instcol2, valcol2, opts1, opts2, missing_format, report);
+    }
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    std::chrono::high_resolution_clock::time_point t_summary;
+    RunReport run;
+    {
+        // Every large structure of the run lives in `region`. Leaving this scope frees its
+        // blocks in bulk instead of destroying billions of nodes one by one.
+        Region region;
+        Arena& arena = region.main();
+        TrackedResource& key_lists = region.tracked(arena, MemCategory::KeyLists);
+        std::unique_ptr<StringDictionary> dict;
+        if (args.count("--dict_values")) {
+            dict = std::make_unique<StringDictionary>(region);
+            parse_opts.dict = dict.get();
+        }
+
+        // When following, the two files are read concurrently so a static file is parsed
+        // while the other one is still being written.
+        using ParseResult = std::pair<InstanceDataMap, InstanceSet>;
+        ParseOptions opts1 = parse_opts, opts2 = parse_opts;
+        opts1.oneshot = args.count("--oneshot1") > 0;
+        opts2.oneshot = args.count("--oneshot2") > 0;
+        if (normalize1) opts1.normalizer = &norm1;
+        if (normalize2) opts2.normalizer = &norm2;
+        if (use_expr1) opts1.expr = &expr1;
+        if (use_expr2) opts2.expr = &expr2;
+        if (use_where1) opts1.where = &where1;
+        if (use_where2) opts2.where = &where2;
+        // With valid indexes of both files sorted by key, --sample reads only sampled blocks.
+        // (An index holds the keys as they were when it was built, so not with --normalize.)
+        std::unique_ptr<SparseSample> sparse;
+        LineIndex index1, index2;
+        if (sample < 1 && parse_opts.use_index && !follow1 && !follow2 && !normalize1 && !normalize2 &&
+            load_line_index(args["--file1"], index1) && load_line_index(args["--file2"], index2) &&
+            index1.inst_cols == instcol1 && index2.inst_cols == instcol2) {
+            sparse = std::make_unique<SparseSample>();
+            if (plan_sparse_sample(index1, index2, parse_opts.sample_below, *sparse)) {
+                opts1.sample_below = opts2.sample_below = UINT64_MAX;
+                opts1.key_ranges = opts2.key_ranges = &sparse->keys;
+                opts1.byte_ranges = &sparse->bytes1;
+                opts2.byte_ranges = &sparse->bytes2;
+            } else {
+                sparse.reset();
+            }
+        }
+        auto parse = [&](const std::string& path, const std::vector<int>& cols, int valcol, bool tail,
+                         const ParseOptions& opts) {
+            if (!tail) return parallel_parse_file(path, cols, valcol, region, opts);
+            return with_line_parser(cols.size(), opts.delim, opts.mode, [&](auto tag) {
+                return follow_parse_file<typename decltype(tag)::type>(path, cols, valcol, region, opts, follow_opts);
+            });
+        };
+        auto parse1 = [&] { return parse(args["--file1"], instcol1, valcol1, follow1, opts1); };
+        auto parse2 = [&] { return parse(args["--file2"], instcol2, valcol2, follow2, opts2); };
+
+        std::optional<ParseResult> result1, result2;
+        std::unique_ptr<BloomFilter> semijoin_filter;
+        if (follow1 || follow2) {
+            auto fut1 = std::async(std::launch::async, parse1);
+            result2.emplace(parse2());
+            result1.emplace(fut1.get());
+        } else if (semijoin) {
+            // Parse the smaller file first. A Bloom filter of its keys lets the parse of the
+            // larger file skip the values of rows that cannot match.
+            uint64_t size1 = 0, size2 = 0;
+            int64_t mtime;
+            stat_file(args["--file1"], size1, mtime);
+            stat_file(args["--file2"], size2, mtime);
+            bool file2_first = size2 < size1;
+            std::optional<ParseResult>& small = file2_first ? result2 : result1;
+            std::optional<ParseResult>& large = file2_first ? result1 : result2;
+            small.emplace(file2_first ? parse2() : parse1());
+            semijoin_filter = std::make_unique<BloomFilter>(small->second.size());
+            for (const auto& key : small->second) semijoin_filter->add(key.hash());
+            std::cout << "Semi-join filter: " << small->second.size() << " keys in "
+                      << semijoin_filter->bytes() / 1024 << " KiB" << std::endl;
+            (file2_first ? opts1 : opts2).filter = semijoin_filter.get();
+            large.emplace(file2_first ? parse1() : parse2());
+        } else {
+            result1.emplace(parse1());
+            result2.emplace(parse2());
+        }
+
+        region.end_phase("parse");
+
+        auto& data1 = arena.make<InstanceDataMap>(std::move(result1->first));
+        auto& instances1 = arena.make<InstanceSet>(std::move(result1->second));
+        auto& data2 = arena.make<InstanceDataMap>(std::move(result2->first));
+        auto& instances2 = arena.make<InstanceSet>(std::move(result2->second));
+
+        std::cout << "\nComparing data..." << std::endl;
+        auto& missing_in_file2 = arena.make<KeyList>(&key_lists);
+        auto& missing_in_file1 = arena.make<KeyList>(&key_lists);
+        auto& matched_instances = arena.make<KeyList>(&key_lists);
+        for (const auto& inst : instances1) {
+            if (instances2.count(inst)) {
+                matched_instances.push_back(inst);
+            } else {
+                missing_in_file2.push_back(inst);
+            }
+        }
+        for (const auto& inst : instances2) {
+            if (!instances1.count(inst)) {
+                missing_in_file1.push_back(inst);
+            }
+        }
+
+        // With --where, a matched key is compared if its value passed the predicate of a
+        // file that has one. A side that failed (or has no predicate) only kept the key, so
+        // those values are read back in a second, filtered pass. The collapsed missing list
+        // still sees every matched key.
+        size_t below_where = 0, unreadable = 0;  // matched keys not compared
+        KeyList* all_matched = &matched_instances;
+        if (use_where1 || use_where2) {
+            if (missing_format == MissingFormat::Collapsed) {
+                KeyList& all = arena.make<KeyList>(&key_lists);
+                all = matched_instances;
+                all_matched = &all;
+            }
+            KeyList backfill1(&key_lists), backfill2(&key_lists);
+            size_t kept = 0;
+            for (const auto& key : matched_instances) {
+                bool has1 = data1.count(key) > 0, has2 = data2.count(key) > 0;
+                if (!((use_where1 && has1) || (use_where2 && has2))) continue;
+                if (!has1) backfill1.push_back(key);
+                if (!has2) backfill2.push_back(key);
+                matched_instances[kept++] = key;
+            }
+            below_where = matched_instances.size() - kept;
+            matched_instances.erase(matched_instances.begin() + kept, matched_instances.end());
+            backfill_values(args["--file1"], instcol1, valcol1, backfill1, data1, region, opts1);
+            backfill_values(args["--file2"], instcol2, valcol2, backfill2, data2, region, opts2);
+            // A key whose value can't be read back (e.g. it was out of range) isn't compared.
+            auto readable_end = std::remove_if(matched_instances.begin(), matched_instances.end(), [&](const InstanceKey& key) {
+                return !data1.count(key) || !data2.count(key);
+            });
+            unreadable = static_cast<size_t>(matched_instances.end() - readable_end);
+            matched_instances.erase(readable_end, matched_instances.end());
+            region.end_phase("where");
+        }
+        std::sort(missing_in_file1.begin(), missing_in_file1.end(), key_display_less);
+        std::sort(missing_in_file2.begin(), missing_in_file2.end(), key_display_less);
+        std::sort(matched_instances.begin(), matched_instances.end(), key_display_less);
+        if (all_matched != &matched_instances) std::sort(all_matched->begin(), all_matched->end(), key_display_less);
+        std::vector<ToleranceVerdict> verdicts;
+        if (tolerances) {
+            unsigned workers = parse_opts.workers ? parse_opts.workers : std::max(1u, std::thread::hardware_concurrency());
+            verdicts = check_tolerances(*tolerances, data1, data2, matched_instances, workers);
+        }
+        region.end_phase("compare");
+
+        // Leftovers placed at the same spot under different names are paired by location
+        // and taken off the missing lists.
+        std::vector<LocatedInstance> located1, located2;
+        std::vector<LocationMatch> location_matches;
+        if (nearest_dist >= 0) {
+            std::cout << "Matching unmatched instances by location..." << std::endl;
+            located1 = collect_locations(args["--file1"], instcol1, loc1, missing_in_file2, opts1);
+            located2 = collect_locations(args["--file2"], instcol2, loc2, missing_in_file1, opts2);
+            unsigned workers = parse_opts.workers ? parse_opts.workers : std::max(1u, std::thread::hardware_concurrency());
+            location_matches = match_by_location(located1, located2, nearest_dist, loc1.cell >= 0, workers);
+            std::vector<char> paired1(missing_in_file2.size(), 0), paired2(missing_in_file1.size(), 0);
+            for (const auto& m : location_matches) {
+                paired1[located1[m.first].index] = 1;
+                paired2[located2[m.second].index] = 1;
+            }
+            remove_flagged(missing_in_file2, paired1);
+            remove_flagged(missing_in_file1, paired2);
+            region.end_phase("nearest");
+        }
+
+        // Suggest a counterpart for each key still missing from file2 among the keys
+        // missing from file1, e.g. a renamed hierarchy level or an added suffix.
+        std::vector<KeySuggestion> suggestions;
+        if (suggest_edits >= 0) {
+            std::cout << "Suggesting renamed keys within " << suggest_edits << " edits..." << std::endl;
+            unsigned workers = parse_opts.workers ? parse_opts.workers : std::max(1u, std::thread::hardware_concurrency());
+            suggestions = suggest_renamed_keys(missing_in_file2, missing_in_file1, qgram, static_cast<size_t>(suggest_edits), workers);
+            region.end_phase("suggest");
+        }
+
+        // Raw value text is only needed for the matched rows of comparison.csv.
+        std::unique_ptr<MappedFile> map1, map2;
+        if (parse_opts.lazy_raw) {
+            TrackedResource& raw_values = region.tracked(arena, MemCategory::RawValues);
+            if (lazy_raw_mmap) {
+                map1 = std::make_unique<MappedFile>(args["--file1"]);
+                map2 = std::make_unique<MappedFile>(args["--file2"]);
+            }
+            rehydrate_raw_values(args["--file1"], data1, matched_instances, map1 ? map1.get() : nullptr, raw_values);
+            rehydrate_raw_values(args["--file2"], data2, matched_instances, map2 ? map2.get() : nullptr, raw_values);
+            if (!location_matches.empty()) {
+                KeyList paired1(&key_lists), paired2(&key_lists);
+                for (const auto& m : location_matches) {
+                    if (data1.count(located1[m.first].key)) paired1.push_back(located1[m.first].key);
+                    if (data2.count(located2[m.second].key)) paired2.push_back(located2[m.second].key);
+                }
+                rehydrate_raw_values(args["--file1"], data1, paired1, map1 ? map1.get() : nullptr, raw_values);
+                rehydrate_raw_values(args["--file2"], data2, paired2, map2 ? map2.get() : nullptr, raw_values);
+            }
+        }
+
+        std::cout << "Writing output files..." << std::endl;
+        std::string f1_basename = args["--file1"].substr(args["--file1"].find_last_of("/\\") + 1);
+        std::string f2_basename = args["--file2"].substr(args["--file2"].find_last_of("/\\") + 1);
+
+        write_missing_file(f1_basename, f2_basename, missing_in_file2, missing_in_file1, missing_format, all_matched);
+        if (!matched_instances.empty()) {
+            write_comparison_csv(f1_basename, f2_basename, data1, data2, matched_instances,
+                                 tolerances.get(), tolerances ? &verdicts : nullptr);
+        } else {
+            std::cout << "Note: No matched instances found; comparison.csv will be empty." << std::endl;
+        }
+        if (suggest_edits >= 0) {
+            write_suggestions(f1_basename, f2_basename, missing_in_file2, missing_in_file1, suggestions);
+        }
+        if (nearest_dist >= 0) {
+            write_location_matches(f1_basename, f2_basename, located1, located2, location_matches, data1, data2);
+        }
+        region.end_phase("output");
+
+        int snapshots_written = -1;
+        if (args.count("--snapshot")) {
+            // Each file's keys are sorted (and, with --lazy_raw, their raw values read back)
+            // on its own arena, so both snapshots are prepared and written concurrently.
+            const InstanceDataMap* snap_data[2] = {&data1, &data2};
+            const KeyList* snap_keys[2];
+            const std::string sources[2] = {args["--file1"], args["--file2"]};
+            MappedFile* maps[2] = {map1.get(), map2.get()};
+            std::future<void> prepared[2];
+            for (int i = 0; i < 2; ++i) {
+                Arena& side = region.new_arena(1u << 20);
+                KeyList* keys = &side.make<KeyList>(&region.tracked(side, MemCategory::KeyLists));
+                TrackedResource* raw_values = &region.tracked(side, MemCategory::RawValues);
+                InstanceDataMap* data = i == 0 ? &data1 : &data2;
+                snap_keys[i] = keys;
+                prepared[i] = std::async(std::launch::async, [&, i, keys, raw_values, data] {
+                    keys->reserve(data->size());
+                    for (const auto& entry : *data) keys->push_back(entry.first);
+                    std::sort(keys->begin(), keys->end(), key_display_less);
+                    if (parse_opts.lazy_raw) rehydrate_raw_values(sources[i], *data, *keys, maps[i], *raw_values);
+                });
+            }
+            for (auto& p : prepared) p.get();
+            std::string error;
+            const std::string settings[2] = {snapshot_settings(args, 1), snapshot_settings(args, 2)};
+            snapshots_written = snapshot_files(args["--snapshot"], sources, settings, snap_data, snap_keys, error);
+            if (snapshots_written < 0) std::cerr << "Warning: " << error << "; no snapshot was written." << std::endl;
+            region.end_phase("snapshot");
+        }
+
+        size_t history_run = 0, history_keys = 0;
+        if (args.count("--history")) {
+            std::string error;
+            unsigned workers = parse_opts.workers ? parse_opts.workers : std::max(1u, std::thread::hardware_concurrency());
+            history_run = append_history(args["--history"], args["--file1"], args["--file2"], data1, data2, matched_instances,
+                                         missing_in_file2, missing_in_file1, workers, history_keys, error);
+            if (!history_run) std::cerr << "Warning: " << error << "; the run was not added to the history." << std::endl;
+            region.end_phase("history");
+        }
+
+        auto t_end = std::chrono::high_resolution_clock::now();
+        double elapsed_time_ms = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+
+        // Teardown is timed from here: the summary, the JSON report and releasing the run's
+        // memory (or, with --fast_exit, everything up to _Exit).
+        t_summary = t_end;
+        std::cout << "\n===================================\n";
+        std::cout << "✅ All tasks completed.\n";
+        std::cout << "===================================\n";
+        std::cout << "Instances in " << f1_basename << ": " << instances1.size() << "\n";
+        std::cout << "Instances in " << f2_basename << ": " << instances2.size() << "\n";
+        std::cout << "Matched Instances: " << matched_instances.size() + below_where + unreadable << "\n";
+        if (use_where1 || use_where2) {
+            std::cout << "  compared (passing --where): " << matched_instances.size() << ", below it in every file: " << below_where
+                      << (unreadable ? ", value not readable back: " + std::to_string(unreadable) : "") << "\n";
+        }
+        std::cout << "Missing from " << f2_basename << ": " << missing_in_file2.size() << "\n";
+        std::cout << "Missing from " << f1_basename << ": " << missing_in_file1.size() << "\n";
+        size_t outside_tolerance = 0, checked_tolerance = 0;
+        for (const auto& v : verdicts) {
+            checked_tolerance += v.within >= 0;
+            outside_tolerance += v.within == 0;
+        }
+        if (tolerances) {
+            std::cout << "Outside tolerance: " << outside_tolerance << " of " << checked_tolerance
+                      << " numeric pairs (" << tolerances->size() << " rules)\n";
+        }
+        if (sample < 1) {
+            print_sample_estimates(f1_basename, f2_basename, sample, sparse.get(), matched_instances, missing_in_file2,
+                                   missing_in_file1, sampled_deviations(data1, data2, matched_instances));
+            std::cout << "  (the counts before the estimates and the output files cover the sampled keys only)\n";
+        }
+        if (suggest_edits >= 0) std::cout << "Suggested renames: " << suggestions.size() << " (suggested_matches.csv)\n";
+        if (nearest_dist >= 0) std::cout << "Matched by location: " << location_matches.size() << " (location_matches.csv)\n";
+        if (snapshots_written >= 0) {
+            std::cout << "Snapshots: " << snapshots_written << " written to " << args["--snapshot"]
+                      << (snapshots_written < 2 ? " (files snapshotted before with the same size, mtime and options are skipped)" : "") << "\n";
+        }
+        if (history_run) {
+            std::cout << "History: run " << history_run << " appended to " << args["--history"] << " (" << history_keys << " new keys)\n";
+        }
+        if (dict) std::cout << "Distinct string values (dictionary): " << dict->size() << "\n";
+        std::cout << "Arena memory reserved: " << region.bytes_reserved() / (1024.0 * 1024.0) << " MiB\n";
+        print_memory_breakdown(region.phases());
+        // Bucket arrays are part of the merged maps' bytes above; nodes are the rest.
+        size_t bucket_bytes = sizeof(void*) * (data1.bucket_count() + instances1.bucket_count() +
+                                               data2.bucket_count() + instances2.bucket_count());
+        std::cout << "  of which merged map buckets: " << bucket_bytes / (1024.0 * 1024.0) << " MiB\n";
+        std::cout << "\nTotal execution time: " << elapsed_time_ms / 1000.0 << " seconds\n";
+
+        run.file1 = args["--file1"];
+        run.file2 = args["--file2"];
+        run.instances1 = instances1.size();
+        run.instances2 = instances2.size();
+        run.matched = matched_instances.size() + below_where + unreadable;
+        run.missing_in_file2 = missing_in_file2.size();
+        run.missing_in_file1 = missing_in_file1.size();
+        run.dict_values = dict ? dict->size() : 0;
+        run.location_matches = location_matches.size();
+        run.outside_tolerance = outside_tolerance;
+        run.suggestions = suggestions.size();
+        run.bucket_bytes = bucket_bytes;
+        run.elapsed_seconds = elapsed_time_ms / 1000.0;
+        run.memory = region.phases();
+
+        if (fast_exit) {
+            // All output files are closed by now; only the JSON report and stdout remain,
+            // and the process ends with its maps still allocated.
+            run.teardown_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_summary).count();
+            std::cout << "Teardown time: " << run.teardown_seconds << " seconds (fast exit)" << std::endl;
+            if (args.count("--json_report") && !write_json_report(args["--json_report"], run)) {
+                std::cerr << "Warning: Could not write JSON report " << args["--json_report"] << std::endl;
+            }
+            std::cout.flush();
+            std::_Exit(0);
+        }
+    }
+
+    run.teardown_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_summary).count();
+    std::cout << "Teardown time: " << run.teardown_seconds << " seconds" << std::endl;
+    if (args.count("--json_report") && !write_json_report(args["--json_report"], run)) {
+        std::cerr << "Warning: Could not write JSON report " << args["--json_report"] << std::endl;
+    }
+    if (report) *report = std::move(run);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// bench subcommand
+// ---------------------------------------------------------------------------
+
+// Drops a file's pages from the page cache. POSIX_FADV_DONTNEED needs no privileges;
+// pages that are dirty or mapped by another process stay resident.
+bool evict_from_page_cache(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Runs the full comparison for each thread count of the sweep, first with both inputs
+// evicted from the page cache (cold) and then again with them cached (warm). Speedup and
+// parallel efficiency are relative to the smallest thread count; the cold/warm gap is the
+// I/O-bound share of a run.
+int run_bench(std::unordered_map<std::string, std::string>& args) {
+    if (!args.count("--file1") || !args.count("--file2")) {
+        std::cerr << "❌ Error: bench requires --file1 and --file2 (and the usual column options)." << std::endl;
+        return 1;
+    }
+    std::vector<unsigned> sweep;
+    int repeat = 1;
+    try {
+        if (args.count("--threads")) {
+            for (const auto& t : split(args["--threads"], ',')) sweep.push_back(static_cast<unsigned>(std::stoul(t)));
+        }
+        if (args.count("--repeat")) repeat = std::max(1, std::stoi(args["--repeat"]));
+    } catch (const std::exception&) {
+        std::cerr << "❌ Error: Invalid --threads or --repeat. Please provide comma-separated integers." << std::endl;
+        return 1;
+    }
+    if (sweep.empty()) {
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned n = 1; n < hw; n *= 2) sweep.push_back(n);
+        sweep.push_back(hw);
+    }
+    if (std::find(sweep.begin(), sweep.end(), 0u) != sweep.end()) {
+        std::cerr << "❌ Error: Thread counts must be positive." << std::endl;
+        return 1;
+    }
+
+    uint64_t size1 = 0, size2 = 0;
+    int64_t mtime;
+    if (!stat_file(args["--file1"], size1, mtime) || !stat_file(args["--file2"], size2, mtime)) {
+        std::cerr << "❌ Error: Cannot stat the input files." << std::endl;
+        return 1;
+    }
+    double input_mib = (size1 + size2) / (1024.0 * 1024.0);
+
+    std::unordered_map<std::string, std::string> run_args = args;
+    run_args.erase("--repeat");
+    run_args.erase("--json_report");
+    run_args.erase("--fast_exit");
+    run_args.erase("--history");
+    run_args.erase("--snapshot");
+
+    std::cout << "Benchmarking " << args["--file1"] << " vs " << args["--file2"] << " (" << input_mib
+              << " MiB), best of " << repeat << "; each run rewrites the output files.\n\n";
+
+    // Keeps the fastest of `repeat` runs with `threads` workers; their console output is discarded.
+    auto measure = [&](unsigned threads, bool cold, RunReport& best) {
+        run_args["--threads"] = std::to_string(threads);
+        for (int r = 0; r < repeat; ++r) {
+            if (cold && !(evict_from_page_cache(args["--file1"]) && evict_from_page_cache(args["--file2"]))) {
+                std::cerr << "Warning: Could not evict the inputs from the page cache." << std::endl;
+            }
+            std::ostringstream sink;
+            std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+            RunReport report;
+            int rc = run_compare(run_args, &report);
+            std::cout.rdbuf(saved);
+            if (rc != 0) return rc;
+            if (r == 0 || report.elapsed_seconds < best.elapsed_seconds) best = std::move(report);
+        }
+        return 0;
+    };
+
+    std::cout << std::left << std::setw(9) << "threads" << std::setw(7) << "cache" << std::right
+              << std::setw(10) << "seconds" << std::setw(10) << "MiB/s" << std::setw(9) << "speedup"
+              << std::setw(12) << "efficiency" << std::setw(10) << "parse" << std::setw(10) << "compare"
+              << std::setw(10) << "output" << std::setw(11) << "I/O share" << "\n";
+    std::ostringstream stats;
+    double base_seconds[2] = {0, 0};
+    for (unsigned threads : sweep) {
+        RunReport runs[2];  // [0] warm, [1] cold
+        for (int cold = 1; cold >= 0; --cold) {
+            if (int rc = measure(threads, cold, runs[cold])) {
+                std::cerr << "❌ Error: Comparison with " << threads << " threads failed." << std::endl;
+                return rc;
+            }
+        }
+        for (int cold = 1; cold >= 0; --cold) {
+            const RunReport& run = runs[cold];
+            double seconds = run.elapsed_seconds;
+            if (threads == sweep.front()) base_seconds[cold] = seconds;
+            double throughput = seconds > 0 ? input_mib / seconds : 0;
+            double speedup = seconds > 0 ? base_seconds[cold] / seconds : 0;
+            double efficiency = speedup * sweep.front() / threads;
+            double io_share = cold && seconds > 0 ? std::max(0.0, 1.0 - runs[0].elapsed_seconds / seconds) : 0;
+            double phase[3] = {0, 0, 0};
+            for (const auto& p : run.memory) {
+                if (p.name == "parse") phase[0] += p.seconds;
+                else if (p.name == "output") phase[2] += p.seconds;
+                else phase[1] += p.seconds;  // compare and secondary matching
+            }
+            const char* cache = cold ? "cold" : "warm";
+
+            std::cout << std::left << std::setw(9) << threads << std::setw(7) << cache << std::right << std::fixed
+                      << std::setprecision(3) << std::setw(10) << seconds
+                      << std::setprecision(1) << std::setw(10) << throughput
+                      << std::setprecision(2) << std::setw(9) << speedup
+                      << std::setprecision(1) << std::setw(11) << efficiency * 100 << "%"
+                      << std::setprecision(3) << std::setw(10) << phase[0] << std::setw(10) << phase[1] << std::setw(10) << phase[2];
+            if (cold) std::cout << std::setprecision(1) << std::setw(10) << io_share * 100 << "%";
+            std::cout << "\n";
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setprecision(6);
+
+            stats << "BENCH_STATS:threads=" << threads << ",cache=" << cache << ",seconds=" << seconds
+                  << ",mib_per_s=" << throughput << ",speedup=" << speedup << ",efficiency=" << efficiency
+                  << ",parse_s=" << phase[0] << ",compare_s=" << phase[1] << ",output_s=" << phase[2] << "\n";
+        }
+    }
+    std::cout << "\n" << stats.str();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // A leading word that is not an option selects a subcommand.
+    std::string command;
+    int first_arg = 1;
+    if (argc > 1 && argv[1][0] != '-') {
+        command = argv[1];
+        first_arg = 2;
+    }
+
+    std::unordered_map<std::string, std::string> args;
+    // Simple argument parsing. An option not followed by a value is a flag and gets "1".
+    for (int i = first_arg; i < argc; ++i) {
+        if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+            args[argv[i]] = argv[i + 1];
+            ++i;
+        } else {
+            args[argv[i]] = "1";
+        }
+    }
+
+    if (command == "profile") {
+        return run_profile(args);
+    } else if (command == "fetch") {
+        return run_fetch(args);
+    } else if (command == "microbench") {
+        return run_microbench(args);
+    } else if (command == "bench") {
+        return run_bench(args);
+    } else if (command == "history") {
+        return run_history(args);
+    } else if (command == "lookup") {
+        return run_lookup(args);
+    } else if (!command.empty()) {
+        std::cerr << "❌ Error: Unknown subcommand '" << command << "'." << std::endl;
+        return 1;
+    }
+
+    // Interactive mode if arguments are missing
+    if (args.find("--file1") == args.end()) {
+        std::cout << "Entering interactive mode...\n";
+        std::cout << "Enter path to first file: ";
+        std::cin >> args["--file1"];
+        std::cout << "Enter instance match column indexes (e.g., 0,1) for file1: ";
+        std::cin >> args["--instcol1"];
+        std::cout << "Enter value column index for file1: ";
+        std::cin >> args["--valcol1"];
+        std::cout << "Enter path to second file: ";
+        std::cin >> args["--file2"];
+        std::cout << "Enter instance match column indexes (e.g., 0,1) for file2: ";
+        std::cin >> args["--instcol2"];
+        std::cout << "Enter value column index for file2: ";
+        std::cin >> args["--valcol2"];
+    }
+
+    return run_compare(args);
 }
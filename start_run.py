@@ -7,9 +7,28 @@ from pathlib import Path
 
 # --- Helper Functions for Sharding (moved from sharder.py) ---
 
+COMPARER_EXEC = Path(__file__).resolve().parent / "comparer"
+
+def profile_line_count(file_path):
+    """Gets the line count from the C++ comparer's 'profile' subcommand, if it is built."""
+    if not COMPARER_EXEC.is_file():
+        return None
+    try:
+        result = subprocess.run([str(COMPARER_EXEC), "profile", "--file", str(file_path)],
+                                capture_output=True, text=True, check=True)
+    except (OSError, subprocess.CalledProcessError):
+        return None
+    match = re.search(r"PROFILE_STATS:total_lines=(\d+)", result.stdout)
+    return int(match.group(1)) if match else None
+
 def get_line_count(file_path):
     """Counts the number of lines in a file and reports it."""
     print(f"Counting lines in {file_path.name}...")
+    if file_path.is_file():
+        count = profile_line_count(file_path)
+        if count is not None:
+            print(f"-> Found {count:,} lines.")
+            return count
     try:
         with open(file_path, "r", errors='ignore') as f:
             count = sum(1 for _ in f)